@@ -1,13 +1,23 @@
 #ifndef EASYLISP_AST_HPP
 #define EASYLISP_AST_HPP
 
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <memory_resource>
+#include <new>
 #include <string>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include "config.hpp"
+#include "heap.hpp"
+#include "symbol.hpp"
+#include "token.hpp"
+
+class Environment;
+class Value;
 
 struct NumberExpr;
 struct ApplyExpr;
@@ -54,16 +64,103 @@ struct Expr {
   virtual void accept(ExprVisitor& visitor) const = 0;
 };
 
+class AstArena;
+
+/**
+ * @brief An owning pointer to an expression, which keeps the arena of the
+ * expression alive
+ *
+ * The arena counts its references itself, so copying an ExprPtr, as the tree
+ * walker does for every application of a procedural, is a plain increment.
+ */
+class ExprPtr {
+  Ref<const AstArena> arena_;
+  const Expr* expr_ = nullptr;
+
+public:
+  ExprPtr() noexcept = default;
+  ExprPtr(std::nullptr_t) noexcept {}
+  ExprPtr(Ref<const AstArena> arena, const Expr* expr) noexcept
+      : arena_{MOV(arena)}, expr_{expr}
+  {}
+
+  [[nodiscard]] auto get() const noexcept -> const Expr* { return expr_; }
+  auto operator*() const noexcept -> const Expr& { return *expr_; }
+  auto operator->() const noexcept -> const Expr* { return expr_; }
+  explicit operator bool() const noexcept { return expr_ != nullptr; }
+
+  [[nodiscard]] friend auto operator==(const ExprPtr& ptr,
+                                       std::nullptr_t) noexcept -> bool
+  {
+    return ptr.expr_ == nullptr;
+  }
+
+  /// @brief The arena that owns the expression
+  [[nodiscard]] auto arena() const noexcept -> const Ref<const AstArena>&
+  {
+    return arena_;
+  }
+};
+
 /**
- * @brief A type alias for pointers to expression
+ * @brief Owns the expressions of a parsed program
+ *
+ * Expressions are allocated contiguously in large blocks and refer to their
+ * children with plain pointers, so a program is a few big allocations. The
+ * arena lives on the heap to be reference counted, but it never refers to
+ * heap objects itself. Its blocks come from the memory resource of the heap.
  */
-using ExprPtr = std::shared_ptr<Expr>;
+class AstArena : public HeapObject {
+  std::pmr::monotonic_buffer_resource resource_;
+  std::pmr::vector<const Expr*> exprs_{&resource_};
+
+public:
+  AstArena() : resource_{Heap::current().resource()} {}
+  ~AstArena() override
+  {
+    for (auto itr = exprs_.rbegin(); itr != exprs_.rend(); ++itr) {
+      if (*itr != nullptr) { (*itr)->~Expr(); }
+    }
+  }
+  AstArena(const AstArena&) = delete;
+  auto operator=(const AstArena&) & -> AstArena& = delete;
+  AstArena(AstArena&&) = delete;
+  auto operator=(AstArena&&) & -> AstArena& = delete;
+
+  template <typename T, typename... Args>
+  [[nodiscard]] auto make(Args&&... args) -> const T*
+  {
+    // Registers the node before constructing it, so that it is destroyed
+    // if and only if its construction succeeded
+    const auto index = exprs_.size();
+    exprs_.push_back(nullptr);
+    const T* expr =
+        ::new (resource_.allocate(sizeof(T), alignof(T))) T(FWD(args)...);
+    exprs_[index] = expr;
+    return expr;
+  }
+
+  /// @brief The memory resource for the containers inside of expressions
+  [[nodiscard]] auto resource() -> std::pmr::memory_resource*
+  {
+    return &resource_;
+  }
+
+  /// @brief Shares the ownership of the arena with an expression in it
+  [[nodiscard]] auto share(const Expr* expr) const -> ExprPtr
+  {
+    return {Ref<const AstArena>::share(*this), expr};
+  }
+
+  void trace(Tracer&) const override {}
+  void clear_references() override {}
+};
 
 /**
  * @brief A definition define a variable as an expression
  */
 struct Definition {
-  std::string var;
+  Symbol var;
   ExprPtr expr;
 };
 
@@ -87,9 +184,9 @@ using Program = std::vector<Toplevel>;
  * @brief A constant expression that contains a number
  */
 struct NumberExpr : Expr {
-  double value;
+  Number value;
 
-  explicit NumberExpr(double v_) : value{v_} {}
+  explicit NumberExpr(Number v_) : value{v_} {}
 
   EXPR_ACCEPT
 };
@@ -105,13 +202,41 @@ struct BooleanExpr : Expr {
   EXPR_ACCEPT
 };
 
+/**
+ * @brief The location of a variable bound by an enclosing lambda or let
+ * expression: the number of frames to walk up and the slot in that frame
+ */
+struct LexicalAddress {
+  static constexpr std::uint32_t global_slot =
+      std::numeric_limits<std::uint32_t>::max();
+
+  std::uint32_t depth = 0;
+  std::uint32_t slot = global_slot;
+
+  /// @brief Global variables are late-bound and looked up by name
+  [[nodiscard]] auto is_global() const -> bool { return slot == global_slot; }
+};
+
+/**
+ * @brief Remembers the binding that a global variable reference found last
+ * time, which stays valid until the version of global environments changes
+ */
+struct GlobalCache {
+  const Environment* env = nullptr;
+  const Value* value = nullptr;
+  std::uint64_t version = 0;
+};
+
 /**
  * @brief An expression that contains a variable
  */
 struct VariableExpr : Expr {
-  std::string id;
+  Symbol id;
+  // Filled in by the resolver
+  mutable LexicalAddress address;
+  mutable GlobalCache cache;
 
-  explicit VariableExpr(std::string id_) : id{MOV(id_)} {}
+  explicit VariableExpr(Symbol id_) : id{id_} {}
 
   EXPR_ACCEPT
 };
@@ -120,27 +245,51 @@ struct VariableExpr : Expr {
  * @brief An expression that represents a procedural application
  */
 struct ApplyExpr : Expr {
-  ExprPtr func;
-  std::vector<ExprPtr> arguments;
+  const Expr* func;
+  std::pmr::vector<const Expr*> arguments;
 
-  explicit ApplyExpr(ExprPtr func_, std::vector<ExprPtr> args_)
-      : func{MOV(func_)}, arguments(MOV(args_))
+  explicit ApplyExpr(const Expr* func_, std::pmr::vector<const Expr*> args_)
+      : func{func_}, arguments(MOV(args_))
   {}
 
   EXPR_ACCEPT
 };
 
+/**
+ * @brief A free variable of a lambda expression, which its closures copy
+ */
+struct Capture {
+  Symbol variable;
+  // Where the variable is bound, seen from the lambda expression
+  LexicalAddress address;
+};
+
 /**
  * @brief An expression that represents a lambda expression
+ *
+ * Closures are flat: instead of the whole environment they were created in,
+ * they hold a frame with the values of the captured free variables, which the
+ * body addresses as the frame right outside of its parameters.
  */
 struct LambdaExpr : Expr {
-  std::vector<std::string> parameters;
-  ExprPtr body;
-
-  explicit LambdaExpr(std::vector<std::string> parameters_, ExprPtr body_)
-      : parameters{(MOV(parameters_))}, body(MOV(body_))
+  std::pmr::vector<Symbol> parameters;
+  const Expr* body;
+  const AstArena* arena;
+  // Filled in by the resolver, from the memory resource of the parameters
+  mutable std::pmr::vector<Capture> captures;
+
+  explicit LambdaExpr(std::pmr::vector<Symbol> parameters_, const Expr* body_,
+                      const AstArena& arena_)
+      : parameters{(MOV(parameters_))}, body(body_), arena{&arena_},
+        captures{parameters.get_allocator()}
   {}
 
+  /// @brief The body for procedurals, which may outlive the program
+  [[nodiscard]] auto shared_body() const -> ExprPtr
+  {
+    return arena->share(body);
+  }
+
   EXPR_ACCEPT
 };
 
@@ -148,19 +297,19 @@ struct LambdaExpr : Expr {
  * A binding binds a variable to an expression
  */
 struct Binding {
-  std::string variable;
-  ExprPtr expr;
+  Symbol variable;
+  const Expr* expr;
 };
 
 /**
  * @brief An expression that represents a local variable binding
  */
 struct LetExpr : Expr {
-  std::vector<Binding> bindings;
-  ExprPtr body;
+  std::pmr::vector<Binding> bindings;
+  const Expr* body;
 
-  explicit LetExpr(std::vector<Binding> bindings_, ExprPtr body_)
-      : bindings{(MOV(bindings_))}, body(MOV(body_))
+  explicit LetExpr(std::pmr::vector<Binding> bindings_, const Expr* body_)
+      : bindings{(MOV(bindings_))}, body(body_)
   {}
 
   EXPR_ACCEPT
@@ -170,14 +319,13 @@ struct LetExpr : Expr {
  * @brief An expression that represents an if expression
  */
 struct IfExpr : Expr {
-  ExprPtr cond_expr;
-  ExprPtr if_expr;
-  ExprPtr else_expr;
-
-  explicit IfExpr(ExprPtr cond_expr_, ExprPtr if_expr_, ExprPtr else_expr_)
-      : cond_expr{MOV(cond_expr_)}, //
-        if_expr{MOV(if_expr_)},     //
-        else_expr{MOV(else_expr_)}
+  const Expr* cond_expr;
+  const Expr* if_expr;
+  const Expr* else_expr;
+
+  explicit IfExpr(const Expr* cond_expr_, const Expr* if_expr_,
+                  const Expr* else_expr_)
+      : cond_expr{cond_expr_}, if_expr{if_expr_}, else_expr{else_expr_}
   {}
 
   EXPR_ACCEPT
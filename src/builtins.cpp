@@ -1,7 +1,13 @@
 #include "environment.hpp"
 #include "interpreter.hpp"
+#include "value_stack.hpp"
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <limits>
 #include <numeric>
+#include <optional>
 #include <ranges>
 
 namespace {
@@ -58,116 +64,320 @@ void check_arg_is_list(const Value& arg)
   return check_arg(arg, is_list, "list?");
 }
 
-void check_arg_is_pair(const Value& arg)
+auto list_length(const Value& list) -> std::size_t
 {
-  return check_arg(arg, is_pair, "pair?");
+  assert(is_list(list));
+  std::size_t length = 0;
+  for (const auto* node_ptr = list.as_object(); node_ptr != nullptr;
+       node_ptr = static_cast<const Cons*>(node_ptr)->cdr.as_object()) {
+    ++length;
+  }
+  return length;
 }
 
-auto to_vector(const Value& list) -> std::vector<Value>
+// Copies the elements of a list into values, which must have its length
+void copy_list(const Value& list, std::span<Value> values)
 {
-  assert(is_list(list));
-  std::vector<Value> values;
-  {
-    const auto* node_ptr = std::get<ObjectPtr>(list).get();
-    while (node_ptr != nullptr) {
-      const auto* cons_ptr = dynamic_cast<const Cons*>(node_ptr);
-      values.push_back(cons_ptr->car);
-      node_ptr = std::get<ObjectPtr>(cons_ptr->cdr).get();
-    }
+  const auto* node_ptr = list.as_object();
+  for (auto& value : values) {
+    const auto& cons = static_cast<const Cons&>(*node_ptr);
+    value = cons.car;
+    node_ptr = cons.cdr.as_object();
   }
-  return values;
 }
 
 auto to_lisp_list(const Values& args) -> Value
 {
   Value list = nullptr;
   for (const auto& arg : std::ranges::reverse_view(args)) {
-    list = std::make_shared<Cons>(arg, list, true);
+    list = Value::make<Cons>(arg, list, true);
   }
 
   return list;
 }
 
-template <typename BinaryOp> auto builtin_arith_proc(std::string name)
+auto as_sequence(const Value& v) -> const Sequence*
 {
-  return std::make_shared<BuiltinProc>(name, [name](Values args) {
-    check_args_count_greater_equal(name, args.size(), 1);
-    check_arg_is_number(args.front());
-    auto number = std::get<double>(args.front());
-    if (args.size() == 1) { return BinaryOp{}(0, number); }
+  return object_cast<Sequence>(v.as_object());
+}
 
-    return std::accumulate(args.begin() + 1, args.end(), number,
-                           [&](double acc, const Value& arg) {
-                             check_arg_is_number(arg);
-                             return BinaryOp{}(acc, std::get<double>(arg));
-                           });
-  });
+// Calls consume with the elements of a sequence one after another until it
+// returns false, and returns whether it consumed every element.
+//
+// The stages of the sequence run in a loop over the range at its bottom, so
+// sequences nested arbitrarily deep do not nest native calls.
+template <typename Consume>
+auto for_each_element(const Sequence& sequence, Consume&& consume) -> bool
+{
+  // From the outermost stage down to the one above the range
+  std::vector<const Sequence*> stages;
+  const Sequence* range = &sequence;
+  while (range->kind != Sequence::Kind::range) {
+    if (range->kind == Sequence::Kind::take && range->count == 0) {
+      return true;
+    }
+    stages.push_back(range);
+    range = as_sequence(range->source);
+    // Every stage consumes another sequence
+    if (range == nullptr) { return true; }
+  }
+  // The number of elements that every take stage has passed on
+  std::vector<std::size_t> taken(stages.size());
+
+  for (auto i = range->lower; i < range->upper; ++i) {
+    Value element = Value::integer(i);
+    bool filtered = false;
+    // Whether a take stage has passed on all of its elements
+    bool exhausted = false;
+    for (auto stage = stages.size(); stage-- > 0 && !filtered;) {
+      const auto& current = *stages[stage];
+      switch (current.kind) {
+      case Sequence::Kind::map:
+        element = ::apply(current.proc, Values{&element, 1});
+        break;
+      case Sequence::Kind::filter: {
+        const auto keep = ::apply(current.proc, Values{&element, 1});
+        filtered = keep.is_boolean() && !keep.as_boolean();
+        break;
+      }
+      case Sequence::Kind::take:
+        exhausted = exhausted || ++taken[stage] == current.count;
+        break;
+      case Sequence::Kind::range:
+        break;
+      }
+    }
+    if (!filtered && !consume(element)) { return false; }
+    if (exhausted) { return true; }
+  }
+  return true;
 }
 
-auto builtin_eq() -> Value
+// The number of elements that take keeps. Counts beyond the length of any
+// list keep every element.
+[[nodiscard]] auto as_count(const Value& value) -> std::size_t
 {
-  return std::make_shared<BuiltinProc>("eq?", [](Values args) -> Value {
-    check_args_count("eq?", args.size(), 2);
-    return args[0] == args[1];
-  });
+  check_arg_is_number(value);
+  if (value.is_integer()) {
+    const auto count = value.as_integer();
+    return count < 0 ? 0 : static_cast<std::size_t>(count);
+  }
+  const auto count = value.as_double();
+  if (std::isnan(count)) {
+    throw std::runtime_error{
+        fmt::format("Type error: {} is not a count", to_string(value))};
+  }
+  constexpr auto max = std::numeric_limits<std::size_t>::max();
+  if (count <= 0.0) { return 0; }
+  if (count >= static_cast<double>(max)) { return max; }
+  return static_cast<std::size_t>(count);
 }
 
-[[nodiscard]] auto lisp_equal(const Value& lhs, const Value& rhs) -> bool
+[[nodiscard]] auto apply_arithmetic(Intrinsic intrinsic, double lhs,
+                                    double rhs) -> std::optional<Value>
+{
+  switch (intrinsic) {
+  case Intrinsic::add:
+    return lhs + rhs;
+  case Intrinsic::subtract:
+    return lhs - rhs;
+  case Intrinsic::multiply:
+    return lhs * rhs;
+  case Intrinsic::divide:
+    return lhs / rhs;
+  default:
+    return std::nullopt;
+  }
+}
+
+[[nodiscard]] auto checked_multiply(std::int64_t lhs, std::int64_t rhs)
+    -> std::optional<std::int64_t>
+{
+  constexpr auto min = std::numeric_limits<std::int64_t>::min();
+  if (lhs == -1) {
+    if (rhs == min) { return std::nullopt; }
+    return -rhs;
+  }
+  // Wraps around on overflow, which dividing back detects
+  const auto product = static_cast<std::int64_t>(
+      static_cast<std::uint64_t>(lhs) * static_cast<std::uint64_t>(rhs));
+  if (lhs != 0 && product / lhs != rhs) { return std::nullopt; }
+  return product;
+}
+
+// Applies an arithmetic or comparison intrinsic to two integers, or returns
+// nullopt when the result is not an integer because it overflows or is a
+// fraction
+[[nodiscard]] auto apply_integer_arithmetic(Intrinsic intrinsic,
+                                            std::int64_t lhs, std::int64_t rhs)
+    -> std::optional<Value>
 {
-  return std::visit(
-      [](auto&& lhs_, auto&& rhs_) {
-        using T1 = std::remove_cvref_t<decltype(lhs_)>;
-        using T2 = std::remove_cvref_t<decltype(rhs_)>;
-        if constexpr (!std::is_same_v<T1, T2>) {
-          return false;
-        } else if constexpr (!std::is_same_v<T1, ObjectPtr>) {
-          return lhs_ == rhs_;
-        } else {
-          if (lhs_ == nullptr && rhs_ == nullptr) return true;
-          if (lhs_ == nullptr || rhs_ == nullptr) return false;
-          const auto* lhs_cons_ptr = dynamic_cast<const Cons*>(lhs_.get());
-          const auto* rhs_cons_ptr = dynamic_cast<const Cons*>(rhs_.get());
-          if (!lhs_cons_ptr || !rhs_cons_ptr) return lhs_ == rhs_;
-
-          return lisp_equal(lhs_cons_ptr->car, rhs_cons_ptr->car) &&
-                 lisp_equal(lhs_cons_ptr->cdr, rhs_cons_ptr->cdr);
+  constexpr auto min = std::numeric_limits<std::int64_t>::min();
+  constexpr auto max = std::numeric_limits<std::int64_t>::max();
+  switch (intrinsic) {
+  case Intrinsic::add:
+    if ((rhs > 0 && lhs > max - rhs) || (rhs < 0 && lhs < min - rhs)) {
+      return std::nullopt;
+    }
+    return Value::integer(lhs + rhs);
+  case Intrinsic::subtract:
+    if ((rhs < 0 && lhs > max + rhs) || (rhs > 0 && lhs < min + rhs)) {
+      return std::nullopt;
+    }
+    return Value::integer(lhs - rhs);
+  case Intrinsic::multiply:
+    if (const auto product = checked_multiply(lhs, rhs)) {
+      return Value::integer(*product);
+    }
+    return std::nullopt;
+  case Intrinsic::divide:
+    if (rhs == 0 || (lhs == min && rhs == -1) || lhs % rhs != 0) {
+      return std::nullopt;
+    }
+    return Value::integer(lhs / rhs);
+  case Intrinsic::less:
+    return lhs < rhs;
+  case Intrinsic::less_equal:
+    return lhs <= rhs;
+  case Intrinsic::greater:
+    return lhs > rhs;
+  case Intrinsic::greater_equal:
+    return lhs >= rhs;
+  default:
+    return std::nullopt;
+  }
+}
+
+// Applies an arithmetic or comparison intrinsic to two numbers. Integers stay
+// exact, and become doubles only when the result does not fit or is a
+// fraction.
+[[nodiscard]] auto apply_number_intrinsic(Intrinsic intrinsic,
+                                          const Value& lhs, const Value& rhs)
+    -> std::optional<Value>
+{
+  if (lhs.is_integer() && rhs.is_integer()) {
+    if (auto result = apply_integer_arithmetic(intrinsic, lhs.as_integer(),
+                                               rhs.as_integer())) {
+      return result;
+    }
+  }
+  // Compared exactly, since converting a large integer to double rounds it
+  switch (intrinsic) {
+  case Intrinsic::less:
+    return Value::compare_numbers(lhs, rhs) < 0;
+  case Intrinsic::less_equal:
+    return Value::compare_numbers(lhs, rhs) <= 0;
+  case Intrinsic::greater:
+    return Value::compare_numbers(lhs, rhs) > 0;
+  case Intrinsic::greater_equal:
+    return Value::compare_numbers(lhs, rhs) >= 0;
+  default:
+    return apply_arithmetic(intrinsic, lhs.as_number(), rhs.as_number());
+  }
+}
+
+auto builtin_arith_proc(std::string name, Intrinsic intrinsic)
+{
+  return Value::make<BuiltinProc>(
+      name,
+      [name, intrinsic](Values args) -> Value {
+        check_args_count_greater_equal(name, args.size(), 1);
+        check_arg_is_number(args.front());
+        if (args.size() == 1) {
+          return *apply_number_intrinsic(intrinsic, Value::integer(0),
+                                         args.front());
         }
+
+        return std::accumulate(
+            args.begin() + 1, args.end(), args.front(),
+            [&](const Value& acc, const Value& arg) {
+              check_arg_is_number(arg);
+              return *apply_number_intrinsic(intrinsic, acc, arg);
+            });
       },
-      lhs, rhs);
+      intrinsic);
+}
+
+auto builtin_eq() -> Value
+{
+  return Value::make<BuiltinProc>(
+      "eq?",
+      [](Values args) -> Value {
+        check_args_count("eq?", args.size(), 2);
+        return args[0] == args[1];
+      },
+      Intrinsic::eq);
+}
+
+// Compares the tails of lists in a loop, and only recurses into their elements
+[[nodiscard]] auto lisp_equal(const Value& lhs, const Value& rhs) -> bool
+{
+  const Value* lhs_ptr = &lhs;
+  const Value* rhs_ptr = &rhs;
+  while (*lhs_ptr != *rhs_ptr) {
+    const auto* lhs_cons_ptr = object_cast<Cons>(lhs_ptr->as_object());
+    const auto* rhs_cons_ptr = object_cast<Cons>(rhs_ptr->as_object());
+    if (!lhs_cons_ptr || !rhs_cons_ptr ||
+        !lisp_equal(lhs_cons_ptr->car, rhs_cons_ptr->car)) {
+      return false;
+    }
+    lhs_ptr = &lhs_cons_ptr->cdr;
+    rhs_ptr = &rhs_cons_ptr->cdr;
+  }
+  return true;
 }
 
 auto builtin_equal() -> Value
 {
-  return std::make_shared<BuiltinProc>("equal?", [](Values args) -> Value {
+  return Value::make<BuiltinProc>("equal?", [](Values args) -> Value {
     check_args_count("equal?", args.size(), 2);
     return lisp_equal(args[0], args[1]);
   });
 }
 
+template <typename ArgT> [[nodiscard]] auto value_as(const Value& value) -> ArgT
+{
+  if constexpr (std::is_same_v<ArgT, double>) {
+    return value.as_number();
+  } else {
+    return value.as_boolean();
+  }
+}
+
 template <typename ArgT, typename CheckArg, typename BinaryOp>
 auto builtin_binary_proc(CheckArg check_arg, const std::string& name,
-                         BinaryOp op)
+                         BinaryOp op, Intrinsic intrinsic = Intrinsic::none)
 {
-  return std::make_shared<BuiltinProc>(name, [=](Values args) {
-    check_args_count(name, args.size(), 2);
-    check_arg(args[0]);
-    check_arg(args[1]);
-    return op(std::get<ArgT>(args[0]), std::get<ArgT>(args[1]));
-  });
+  return Value::make<BuiltinProc>(
+      name,
+      [=](Values args) {
+        check_args_count(name, args.size(), 2);
+        check_arg(args[0]);
+        check_arg(args[1]);
+        return op(value_as<ArgT>(args[0]), value_as<ArgT>(args[1]));
+      },
+      intrinsic);
 }
 
-template <typename BinaryOp>
-auto builtin_compare_proc(const std::string& name, BinaryOp op)
+auto builtin_compare_proc(const std::string& name, Intrinsic intrinsic)
 {
-  return builtin_binary_proc<double>(check_arg_is_number, name, op);
+  return Value::make<BuiltinProc>(
+      name,
+      [=](Values args) -> Value {
+        check_args_count(name, args.size(), 2);
+        check_arg_is_number(args[0]);
+        check_arg_is_number(args[1]);
+        return *apply_number_intrinsic(intrinsic, args[0], args[1]);
+      },
+      intrinsic);
 }
 
 auto builtin_not() -> Value
 {
-  return std::make_shared<BuiltinProc>("not", [](Values args) -> Value {
+  return Value::make<BuiltinProc>("not", [](Values args) -> Value {
     check_args_count("not", args.size(), 1);
     check_arg_is_boolean(args[0]);
-    return !std::get<bool>(args[0]);
+    return !args[0].as_boolean();
   });
 }
 
@@ -179,147 +389,327 @@ auto builtin_logical_proc(const std::string& name, BinaryOp op)
 
 auto builtin_cons() -> Value
 {
-  return std::make_shared<BuiltinProc>("cons", [](Values args) -> Value {
-    check_args_count("cons", args.size(), 2);
-    return std::make_shared<Cons>(args[0], args[1], is_list(args[1]));
-  });
+  return Value::make<BuiltinProc>(
+      "cons",
+      [](Values args) -> Value {
+        check_args_count("cons", args.size(), 2);
+        return Value::make<Cons>(args[0], args[1], is_list(args[1]));
+      },
+      Intrinsic::cons);
 }
 
+// Returns the pair v, or throws if v is not a pair
 auto as_cons(const Value& v) -> const Cons&
 {
-  return dynamic_cast<const Cons&>(*std::get<ObjectPtr>(v));
+  const auto* cons = object_cast<Cons>(v.as_object());
+  if (cons == nullptr) {
+    throw std::runtime_error{
+        fmt::format("Type error: (pair? {}) is false", to_string(v))};
+  }
+  return *cons;
 }
 
 auto builtin_car() -> Value
 {
-  return std::make_shared<BuiltinProc>("car", [](Values args) -> Value {
-    check_args_count("car", args.size(), 1);
-    check_arg_is_pair(args[0]);
-    return as_cons(args[0]).car;
-  });
+  return Value::make<BuiltinProc>(
+      "car",
+      [](Values args) -> Value {
+        check_args_count("car", args.size(), 1);
+        return as_cons(args[0]).car;
+      },
+      Intrinsic::car);
 }
 
 auto builtin_cdr() -> Value
 {
-  return std::make_shared<BuiltinProc>("cdr", [](Values args) -> Value {
-    check_args_count("cdr", args.size(), 1);
-    check_arg_is_pair(args[0]);
-    return as_cons(args[0]).cdr;
-  });
+  return Value::make<BuiltinProc>(
+      "cdr",
+      [](Values args) -> Value {
+        check_args_count("cdr", args.size(), 1);
+        return as_cons(args[0]).cdr;
+      },
+      Intrinsic::cdr);
 }
 
 auto builtin_list() -> Value
 {
-  return std::make_shared<BuiltinProc>(
+  return Value::make<BuiltinProc>(
       "list", [](Values args) { return to_lisp_list(args); });
 }
 
-auto builtin_range() -> Value
+auto builtin_in_range() -> Value
 {
-  return std::make_shared<BuiltinProc>("range", [](Values args) -> Value {
-    check_args_count("range", args.size(), 2);
+  return Value::make<BuiltinProc>("in-range", [](Values args) -> Value {
+    check_args_count("in-range", args.size(), 2);
     check_arg_is_number(args[0]);
     check_arg_is_number(args[1]);
-
-    const int lower = static_cast<int>(std::get<double>(args[0]));
-    const int upper = static_cast<int>(std::get<double>(args[1]));
-    if (upper < lower) return nullptr;
-
-    Value list = nullptr;
-    for (int i = upper - 1; i >= lower; --i) {
-      list = std::make_shared<Cons>(static_cast<double>(i), list, true);
-    }
-    return list;
+    return Value::make<Sequence>(to_integer(args[0]), to_integer(args[1]));
   });
 }
 
+auto builtin_range() -> Value
+{
+  return Value::make<BuiltinProc>(
+      "range",
+      [](Values args) -> Value {
+        check_args_count("range", args.size(), 2);
+        check_arg_is_number(args[0]);
+        check_arg_is_number(args[1]);
+
+        const auto lower = to_integer(args[0]);
+        const auto upper = to_integer(args[1]);
+        Value list = nullptr;
+        for (auto i = upper; i > lower; --i) {
+          list = Value::make<Cons>(Value::integer(i - 1), list, true);
+        }
+        return list;
+      },
+      Intrinsic::range);
+}
+
 template <typename Pred>
-auto builtin_pred(std::string name, Pred&& pred) -> Value
+auto builtin_pred(std::string name, Pred&& pred,
+                  Intrinsic intrinsic = Intrinsic::none) -> Value
 {
-  return std::make_shared<BuiltinProc>(
-      name, [name, pred = FWD(pred)](Values args) -> Value {
+  return Value::make<BuiltinProc>(
+      name,
+      [name, pred = FWD(pred)](Values args) -> Value {
         check_args_count(name, args.size(), 1);
         return pred(args[0]);
-      });
+      },
+      intrinsic);
 }
 
 auto builtin_map() -> Value
 {
-  return std::make_shared<BuiltinProc>("map", [](Values args) -> Value {
-    check_args_count("map", args.size(), 2);
-    check_arg_is_proc(args[0]);
-    check_arg_is_list(args[1]);
+  return Value::make<BuiltinProc>(
+      "map",
+      [](Values args) -> Value {
+        check_args_count("map", args.size(), 2);
+        check_arg_is_proc(args[0]);
+        if (as_sequence(args[1])) {
+          return Value::make<Sequence>(Sequence::Kind::map, args[1], args[0]);
+        }
+        check_arg_is_list(args[1]);
 
-    std::vector<Value> values = to_vector(args[1]);
-    for (auto& value : values) { value = ::apply(args[0], std::vector{value}); }
-    return to_lisp_list(values);
-  });
+        const auto frame = ValueStack::current().push(list_length(args[1]));
+        const auto values = frame.values();
+        copy_list(args[1], values);
+        for (auto& value : values) {
+          value = ::apply(args[0], Values{&value, 1});
+        }
+        return to_lisp_list(values);
+      },
+      Intrinsic::map);
 }
 
 auto builtin_filter() -> Value
 {
-  return std::make_shared<BuiltinProc>("filter", [](Values args) -> Value {
-    check_args_count("filter", args.size(), 2);
-    check_arg_is_proc(args[0]);
-    check_arg_is_list(args[1]);
-
-    std::vector<Value> values = to_vector(args[1]);
-    std::vector<Value> results;
-    results.reserve(values.size());
-    std::ranges::copy_if(values, std::back_inserter(results),
-                         [&](const Value& value) {
-                           const Value value_arr[] = {value};
-                           const auto result = ::apply(args[0], value_arr);
-                           const bool* satisfied = std::get_if<bool>(&result);
-                           return !(satisfied != nullptr && !*satisfied);
-                         });
-    return to_lisp_list(results);
-  });
+  return Value::make<BuiltinProc>(
+      "filter",
+      [](Values args) -> Value {
+        check_args_count("filter", args.size(), 2);
+        check_arg_is_proc(args[0]);
+        if (as_sequence(args[1])) {
+          return Value::make<Sequence>(Sequence::Kind::filter, args[1],
+                                       args[0]);
+        }
+        check_arg_is_list(args[1]);
+
+        const auto frame = ValueStack::current().push(list_length(args[1]));
+        const auto values = frame.values();
+        copy_list(args[1], values);
+        // Moves the kept values to the front
+        std::size_t kept = 0;
+        for (const auto& value : values) {
+          const auto result = ::apply(args[0], Values{&value, 1});
+          if (!(result.is_boolean() && !result.as_boolean())) {
+            values[kept++] = value;
+          }
+        }
+        return to_lisp_list(values.first(kept));
+      },
+      Intrinsic::filter);
 }
 
 auto builtin_foldl() -> Value
 {
-  return std::make_shared<BuiltinProc>("foldl", [](Values args) -> Value {
-    check_args_count("foldl", args.size(), 3);
-    check_arg_is_proc(args[0]);
-    check_arg_is_list(args[2]);
-
-    Value acc = args[1];
-    const auto* node_ptr = std::get<ObjectPtr>(args[2]).get();
-    while (node_ptr != nullptr) {
-      const auto* cons_ptr = dynamic_cast<const Cons*>(node_ptr);
-      acc = ::apply(args[0], std::vector{cons_ptr->car, acc});
-      node_ptr = std::get<ObjectPtr>(cons_ptr->cdr).get();
-    }
-    return acc;
-  });
+  return Value::make<BuiltinProc>(
+      "foldl",
+      [](Values args) -> Value {
+        check_args_count("foldl", args.size(), 3);
+        check_arg_is_proc(args[0]);
+
+        Value acc = args[1];
+        if (const auto* sequence = as_sequence(args[2])) {
+          for_each_element(*sequence, [&](const Value& element) {
+            const std::array apply_args{element, acc};
+            acc = ::apply(args[0], apply_args);
+            return true;
+          });
+          return acc;
+        }
+        check_arg_is_list(args[2]);
+        const auto* node_ptr = args[2].as_object();
+        while (node_ptr != nullptr) {
+          const auto* cons_ptr = static_cast<const Cons*>(node_ptr);
+          const std::array apply_args{cons_ptr->car, acc};
+          acc = ::apply(args[0], apply_args);
+          node_ptr = cons_ptr->cdr.as_object();
+        }
+        return acc;
+      },
+      Intrinsic::foldl);
 }
 
 auto builtin_foldr() -> Value
 {
-  return std::make_shared<BuiltinProc>("foldr", [](Values args) -> Value {
-    check_args_count("foldr", args.size(), 3);
-    check_arg_is_proc(args[0]);
-    check_arg_is_list(args[2]);
+  return Value::make<BuiltinProc>(
+      "foldr",
+      [](Values args) -> Value {
+        check_args_count("foldr", args.size(), 3);
+        check_arg_is_proc(args[0]);
+        check_arg_is_list(args[2]);
+
+        const auto frame = ValueStack::current().push(list_length(args[2]));
+        const auto values = frame.values();
+        copy_list(args[2], values);
+        return std::accumulate(values.rbegin(), values.rend(), args[1],
+                               [&](const Value& acc, const Value& elem) {
+                                 const std::array apply_args{elem, acc};
+                                 return ::apply(args[0], apply_args);
+                               });
+      },
+      Intrinsic::foldr);
+}
 
-    std::vector<Value> values = to_vector(args[2]);
-    return std::accumulate(values.rbegin(), values.rend(), args[1],
-                           [&](const Value& acc, const Value& elem) {
-                             return ::apply(args[0], std::vector{elem, acc});
-                           });
+auto builtin_take() -> Value
+{
+  return Value::make<BuiltinProc>("take", [](Values args) -> Value {
+    check_args_count("take", args.size(), 2);
+    const auto count = as_count(args[1]);
+    if (as_sequence(args[0])) { return Value::make<Sequence>(args[0], count); }
+    check_arg_is_list(args[0]);
+
+    const auto frame = ValueStack::current().push(
+        std::min(count, list_length(args[0])));
+    const auto values = frame.values();
+    copy_list(args[0], values);
+    return to_lisp_list(values);
+  });
+}
+
+auto builtin_sequence_to_list() -> Value
+{
+  return Value::make<BuiltinProc>("sequence->list", [](Values args) -> Value {
+    check_args_count("sequence->list", args.size(), 1);
+    if (is_list(args[0])) { return args[0]; }
+    check_arg(args[0], is_sequence, "sequence?");
+
+    std::vector<Value> elements;
+    for_each_element(*as_sequence(args[0]), [&](const Value& element) {
+      elements.push_back(element);
+      return true;
+    });
+    return to_lisp_list(elements);
   });
 }
 
 auto builtin_print() -> Value
 {
-  return std::make_shared<BuiltinProc>("print", [](Values args) -> Value {
+  return Value::make<BuiltinProc>("print", [](Values args) -> Value {
     check_args_count("print", args.size(), 1);
+    if (const auto* sequence = as_sequence(args[0])) {
+      // Prints the elements as they are computed
+      bool first = true;
+      fmt::print("(");
+      for_each_element(*sequence, [&](const Value& element) {
+        fmt::print("{}{}", first ? "" : " ", to_string(element));
+        first = false;
+        return true;
+      });
+      fmt::print(")\n");
+      return nullptr;
+    }
     fmt::print("{}\n", to_string(args[0]));
     return nullptr;
   });
 }
 } // anonymous namespace
 
+namespace {
+
+// Applies an arithmetic or comparison intrinsic to two fixnums, whose sums and
+// differences cannot overflow, and neither can products of 32-bit integers
+[[nodiscard]] auto apply_fixnum_arithmetic(Intrinsic intrinsic,
+                                           std::int64_t lhs, std::int64_t rhs)
+    -> std::optional<Value>
+{
+  switch (intrinsic) {
+  case Intrinsic::add:
+    return Value::integer(lhs + rhs);
+  case Intrinsic::subtract:
+    return Value::integer(lhs - rhs);
+  case Intrinsic::multiply:
+    if (lhs == static_cast<std::int32_t>(lhs) &&
+        rhs == static_cast<std::int32_t>(rhs)) {
+      return Value::integer(lhs * rhs);
+    }
+    return apply_integer_arithmetic(intrinsic, lhs, rhs);
+  case Intrinsic::less:
+    return lhs < rhs;
+  case Intrinsic::greater:
+    return lhs > rhs;
+  default:
+    return apply_integer_arithmetic(intrinsic, lhs, rhs);
+  }
+}
+
+[[nodiscard]] auto apply_intrinsic(Intrinsic intrinsic, Values args)
+    -> std::optional<Value>
+{
+  if (args.size() == 2) {
+    const Value& lhs = args[0];
+    const Value& rhs = args[1];
+    if (lhs.is_fixnum() && rhs.is_fixnum()) {
+      if (auto result = apply_fixnum_arithmetic(intrinsic, lhs.as_fixnum(),
+                                                rhs.as_fixnum())) {
+        return result;
+      }
+    }
+    if (lhs.is_number() && rhs.is_number()) {
+      if (auto result = apply_number_intrinsic(intrinsic, lhs, rhs)) {
+        return result;
+      }
+    }
+    if (intrinsic == Intrinsic::eq) { return lhs == rhs; }
+    if (intrinsic == Intrinsic::cons) {
+      return Value::make<Cons>(lhs, rhs, is_list(rhs));
+    }
+  } else if (args.size() == 1) {
+    if (intrinsic == Intrinsic::is_null) { return args[0].is_null(); }
+    if (intrinsic == Intrinsic::car || intrinsic == Intrinsic::cdr) {
+      if (const auto* cons = object_cast<Cons>(args[0].as_object())) {
+        return intrinsic == Intrinsic::car ? cons->car : cons->cdr;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+} // anonymous namespace
+
+auto apply_builtin(const BuiltinProc& proc, Values args) -> Value
+{
+  // Unusual arguments, including every error, take the general path
+  if (proc.intrinsic() != Intrinsic::none) {
+    if (auto result = apply_intrinsic(proc.intrinsic(), args)) {
+      return MOV(*result);
+    }
+  }
+  return proc.native_func(args);
+}
+
 Environment::Environment(Environment::create_global_t)
 {
   bindings_.emplace("boolean?", builtin_pred("boolean?", is_boolean));
@@ -327,23 +717,25 @@ Environment::Environment(Environment::create_global_t)
   bindings_.emplace("false", false);
 
   bindings_.emplace("number?", builtin_pred("number?", is_number));
-  bindings_.emplace("+", builtin_arith_proc<std::plus<>>("+"));
-  bindings_.emplace("-", builtin_arith_proc<std::minus<>>("-"));
-  bindings_.emplace("*", builtin_arith_proc<std::multiplies<>>("*"));
-  bindings_.emplace("/", builtin_arith_proc<std::divides<>>("/"));
+  bindings_.emplace("+", builtin_arith_proc("+", Intrinsic::add));
+  bindings_.emplace("-", builtin_arith_proc("-", Intrinsic::subtract));
+  bindings_.emplace("*", builtin_arith_proc("*", Intrinsic::multiply));
+  bindings_.emplace("/", builtin_arith_proc("/", Intrinsic::divide));
 
   bindings_.emplace("eq?", builtin_eq());
   bindings_.emplace("equal?", builtin_equal());
-  bindings_.emplace("<", builtin_compare_proc("<", std::less<>{}));
-  bindings_.emplace("<=", builtin_compare_proc("<=", std::less_equal<>{}));
-  bindings_.emplace(">", builtin_compare_proc(">", std::greater<>{}));
-  bindings_.emplace(">=", builtin_compare_proc(">=", std::greater_equal<>{}));
+  bindings_.emplace("<", builtin_compare_proc("<", Intrinsic::less));
+  bindings_.emplace("<=", builtin_compare_proc("<=", Intrinsic::less_equal));
+  bindings_.emplace(">", builtin_compare_proc(">", Intrinsic::greater));
+  bindings_.emplace(">=",
+                    builtin_compare_proc(">=", Intrinsic::greater_equal));
 
   bindings_.emplace("not", builtin_not());
   bindings_.emplace("and", builtin_logical_proc("and", std::logical_and<>{}));
   bindings_.emplace("or", builtin_logical_proc("or", std::logical_or<>{}));
 
-  bindings_.emplace("null?", builtin_pred("null?", is_null));
+  bindings_.emplace("null?",
+                    builtin_pred("null?", is_null, Intrinsic::is_null));
   bindings_.emplace("null", nullptr);
   bindings_.emplace("pair?", builtin_pred("pair?", is_pair));
   bindings_.emplace("list?", builtin_pred("list?", is_list));
@@ -357,6 +749,11 @@ Environment::Environment(Environment::create_global_t)
   bindings_.emplace("foldl", builtin_foldl());
   bindings_.emplace("foldr", builtin_foldr());
 
+  bindings_.emplace("sequence?", builtin_pred("sequence?", is_sequence));
+  bindings_.emplace("in-range", builtin_in_range());
+  bindings_.emplace("take", builtin_take());
+  bindings_.emplace("sequence->list", builtin_sequence_to_list());
+
   bindings_.emplace("procedural?", builtin_pred("procedural?", is_procedural));
 
   bindings_.emplace("print", builtin_print());
@@ -0,0 +1,68 @@
+#ifndef EASYLISP_BYTECODE_HPP
+#define EASYLISP_BYTECODE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "value.hpp"
+
+/// @brief The operation of a bytecode instruction
+enum class OpCode : std::uint8_t {
+  constant,      ///< Pushes constants[operand]
+  load_local,    ///< Pushes the local variable at (depth, operand)
+  load_global,   ///< Pushes the global variable names[operand]
+  make_closure,  ///< Pushes a closure of the child chunks[operand]
+  call,          ///< Calls a procedure with operand arguments
+  tail_call,     ///< Calls a procedure in tail position, reusing the frame
+  jump,          ///< Jumps to the instruction at operand
+  jump_if_false, ///< Pops a boolean and jumps to operand if it is false
+  enter_let,     ///< Moves the top operand values of the stack into a frame
+  exit_let,      ///< Leaves the innermost let frame
+  return_,       ///< Returns the top of the stack to the caller
+};
+
+/**
+ * @brief A single bytecode instruction
+ */
+struct Instruction {
+  OpCode op;
+  std::uint16_t depth = 0;
+  std::uint32_t operand = 0;
+};
+
+/**
+ * @brief A chunk is the compiled form of a lambda body or a toplevel
+ * expression
+ *
+ * Chunks live on the heap, so that the closures of the virtual machine share
+ * them without atomic reference counting.
+ */
+struct Chunk : HeapObject {
+  std::vector<Instruction> code;
+  std::vector<Value> constants;
+  std::vector<Symbol> names;
+  // The cache of every load_global, indexed like names
+  mutable std::vector<GlobalCache> global_caches;
+  std::vector<Ref<const Chunk>> chunks;
+
+  // The lambda expression this chunk was compiled from, empty for toplevel
+  // expressions
+  std::vector<Symbol> parameters;
+  std::vector<Capture> captures;
+  ExprPtr body;
+
+  void trace(Tracer& tracer) const override
+  {
+    for (const auto& constant : constants) { tracer(constant.as_object()); }
+    for (const auto& child : chunks) { tracer(child); }
+  }
+  void clear_references() override
+  {
+    constants.clear();
+    chunks.clear();
+  }
+};
+
+#endif // EASYLISP_BYTECODE_HPP
@@ -0,0 +1,1000 @@
+#include "closure_compiler.hpp"
+#include "interpreter.hpp"
+#include "value_stack.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+
+struct CompiledExpr {
+  using Function = auto (*)(const CompiledExpr& self, const EnvPtr& env,
+                            TailCall& tail) -> Value;
+
+  explicit CompiledExpr(Function function) : function_{function} {}
+  virtual ~CompiledExpr() = default;
+  CompiledExpr(const CompiledExpr&) = delete;
+  auto operator=(const CompiledExpr&) & -> CompiledExpr& = delete;
+  CompiledExpr(CompiledExpr&&) = delete;
+  auto operator=(CompiledExpr&&) & -> CompiledExpr& = delete;
+
+  /**
+   * @brief Evaluates the expression, which leaves its call in tail when the
+   * expression is compiled in tail position
+   */
+  auto operator()(const EnvPtr& env, TailCall& tail) const -> Value
+  {
+    return function_(*this, env, tail);
+  }
+
+  /// @brief Reports the heap objects that the expression and its children
+  /// refer to
+  virtual void trace(Tracer&) const {}
+
+private:
+  Function function_;
+};
+
+namespace {
+
+using CompiledPtr = std::unique_ptr<const CompiledExpr>;
+
+// Dispatches to Derived::eval without virtual functions
+template <typename Derived> struct Node : CompiledExpr {
+  Node()
+      : CompiledExpr{[](const CompiledExpr& self, const EnvPtr& env,
+                        TailCall& tail) -> Value {
+          return static_cast<const Derived&>(self).eval(env, tail);
+        }}
+  {}
+};
+
+struct Constant : Node<Constant> {
+  Value value;
+
+  explicit Constant(Value value_) : value{MOV(value_)} {}
+
+  auto eval(const EnvPtr&, TailCall&) const -> Value { return value; }
+
+  void trace(Tracer& tracer) const override { tracer(value.as_object()); }
+};
+
+struct LocalVariable : Node<LocalVariable> {
+  LexicalAddress address;
+
+  explicit LocalVariable(LexicalAddress address_) : address{address_} {}
+
+  auto eval(const EnvPtr& env, TailCall&) const -> Value
+  {
+    return env->lookup(address);
+  }
+};
+
+struct GlobalVariable : Node<GlobalVariable> {
+  GlobalRef global;
+
+  explicit GlobalVariable(Symbol id) : global{id} {}
+
+  auto eval(const EnvPtr& env, TailCall&) const -> Value
+  {
+    return global.get(*env);
+  }
+};
+
+struct Lambda : Node<Lambda> {
+  // Both point into the lambda expression, which body_expr keeps alive
+  std::span<const Symbol> parameters;
+  std::span<const Capture> captures;
+  ExprPtr body_expr;
+  Ref<const CompiledCode> body;
+
+  Lambda(const LambdaExpr& expr, Ref<const CompiledCode> body_)
+      : parameters{expr.parameters}, captures{expr.captures},
+        body_expr{expr.shared_body()}, body{MOV(body_)}
+  {}
+
+  auto eval(const EnvPtr& env, TailCall&) const -> Value
+  {
+    return Value::make<Proc>(parameters, body_expr,
+                             capture_environment(captures, env), body);
+  }
+
+  void trace(Tracer& tracer) const override
+  {
+    tracer(body_expr.arena());
+    tracer(body);
+  }
+};
+
+struct Let : Node<Let> {
+  std::vector<CompiledPtr> bindings;
+  CompiledPtr body;
+
+  Let(std::vector<CompiledPtr> bindings_, CompiledPtr body_)
+      : bindings{MOV(bindings_)}, body{MOV(body_)}
+  {}
+
+  auto eval(const EnvPtr& env, TailCall& tail) const -> Value
+  {
+    const auto let_env = [&] {
+      const auto frame = ValueStack::current().push(bindings.size());
+      const auto values = frame.values();
+      for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = (*bindings[i])(env, tail);
+      }
+      return EnvPtr{make_ref<Environment>(env, values)};
+    }();
+    return (*body)(let_env, tail);
+  }
+
+  void trace(Tracer& tracer) const override
+  {
+    for (const auto& binding : bindings) { binding->trace(tracer); }
+    body->trace(tracer);
+  }
+};
+
+struct If : Node<If> {
+  CompiledPtr cond;
+  CompiledPtr then;
+  CompiledPtr otherwise;
+
+  If(CompiledPtr cond_, CompiledPtr then_, CompiledPtr otherwise_)
+      : cond{MOV(cond_)}, then{MOV(then_)}, otherwise{MOV(otherwise_)}
+  {}
+
+  auto eval(const EnvPtr& env, TailCall& tail) const -> Value
+  {
+    return as_condition((*cond)(env, tail)) ? (*then)(env, tail)
+                                            : (*otherwise)(env, tail);
+  }
+
+  void trace(Tracer& tracer) const override
+  {
+    cond->trace(tracer);
+    then->trace(tracer);
+    otherwise->trace(tracer);
+  }
+};
+
+template <bool Tail>
+auto call(const Value& func, Values args, [[maybe_unused]] TailCall& tail)
+    -> Value
+{
+  const auto* obj = func.as_object();
+  if (obj && obj->intrinsic() != Intrinsic::none) {
+    return apply_builtin(static_cast<const BuiltinProc&>(*obj), args);
+  }
+
+  const auto* proc = object_cast<Proc>(obj);
+  if (!proc || !proc->is_compiled()) { return ::apply(func, args); }
+  auto env = bind_arguments(*proc, args);
+  if constexpr (Tail) {
+    tail = TailCall{func, MOV(env)};
+    return Value{};
+  } else {
+    return run_closures(*proc, env);
+  }
+}
+
+// An application with a fixed number of arguments, which live on the native
+// stack
+template <std::size_t Arity, bool Tail>
+struct FixedApply : Node<FixedApply<Arity, Tail>> {
+  CompiledPtr func;
+  std::array<CompiledPtr, Arity> arguments;
+
+  FixedApply(CompiledPtr func_, std::array<CompiledPtr, Arity> arguments_)
+      : func{MOV(func_)}, arguments{MOV(arguments_)}
+  {}
+
+  auto eval(const EnvPtr& env, TailCall& tail) const -> Value
+  {
+    const Value func_val = (*func)(env, tail);
+    std::array<Value, Arity> args;
+    std::size_t i = 0;
+    for (const auto& argument : arguments) {
+      args[i++] = (*argument)(env, tail);
+    }
+    return call<Tail>(func_val, args, tail);
+  }
+
+  void trace(Tracer& tracer) const override
+  {
+    func->trace(tracer);
+    for (const auto& argument : arguments) { argument->trace(tracer); }
+  }
+};
+
+template <bool Tail> struct Apply : Node<Apply<Tail>> {
+  CompiledPtr func;
+  std::vector<CompiledPtr> arguments;
+
+  Apply(CompiledPtr func_, std::vector<CompiledPtr> arguments_)
+      : func{MOV(func_)}, arguments{MOV(arguments_)}
+  {}
+
+  auto eval(const EnvPtr& env, TailCall& tail) const -> Value
+  {
+    const Value func_val = (*func)(env, tail);
+    const auto frame = ValueStack::current().push(arguments.size());
+    const auto args = frame.values();
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      args[i] = (*arguments[i])(env, tail);
+    }
+    return call<Tail>(func_val, args, tail);
+  }
+
+  void trace(Tracer& tracer) const override
+  {
+    func->trace(tracer);
+    for (const auto& argument : arguments) { argument->trace(tracer); }
+  }
+};
+
+// Applies the body of a lambda expression to one element after another
+// without creating a procedural. The environment of the body is reused when
+// the body did not keep it.
+class BodyRunner {
+  const Lambda& lambda_;
+  EnvPtr captured_;
+  Ref<Environment> env_;
+
+public:
+  BodyRunner(const Lambda& lambda, const EnvPtr& env)
+      : lambda_{lambda}, captured_{capture_environment(lambda.captures, env)}
+  {}
+
+  auto operator()(Values args) -> Value
+  {
+    if (env_.is_unique()) {
+      env_->assign(args);
+    } else {
+      env_ = make_ref<Environment>(captured_, args);
+    }
+    return run_closures(*lambda_.body, env_);
+  }
+};
+
+auto list_length(const Value& list) -> std::size_t
+{
+  std::size_t length = 0;
+  for (const auto* node = list.as_object(); node != nullptr;
+       node = static_cast<const Cons*>(node)->cdr.as_object()) {
+    ++length;
+  }
+  return length;
+}
+
+// Copies the elements of a list into values, which must have its length
+void copy_list(const Value& list, std::span<Value> values)
+{
+  const auto* node = list.as_object();
+  for (auto& value : values) {
+    const auto& cons = static_cast<const Cons&>(*node);
+    value = cons.car;
+    node = cons.cdr.as_object();
+  }
+}
+
+auto make_list(Values elements) -> Value
+{
+  Value list = nullptr;
+  for (auto itr = elements.rbegin(); itr != elements.rend(); ++itr) {
+    list = Value::make<Cons>(*itr, list, true);
+  }
+  return list;
+}
+
+// An application of map, filter, foldl or foldr to a lambda expression, which
+// runs the body of the lambda expression in a loop instead of creating a
+// procedural and applying it to every element. The loop is taken only when
+// the global variable still holds the builtin and the argument is a list,
+// otherwise the application runs as usual.
+template <bool Tail> struct FusedLoop : Node<FusedLoop<Tail>> {
+  GlobalRef func;
+  Intrinsic kind;
+  std::unique_ptr<const Lambda> lambda;
+  // The initial value of a fold, or null
+  CompiledPtr init;
+  CompiledPtr list;
+
+  FusedLoop(Symbol id, Intrinsic kind_, std::unique_ptr<const Lambda> lambda_,
+            CompiledPtr init_, CompiledPtr list_)
+      : func{id}, kind{kind_}, lambda{MOV(lambda_)}, init{MOV(init_)},
+        list{MOV(list_)}
+  {}
+
+  auto eval(const EnvPtr& env, TailCall& tail) const -> Value
+  {
+    // Creating the procedural has no effects, so it can be left out of the
+    // order of evaluation
+    const Value func_val = func.get(*env);
+    const Value init_val = init ? (*init)(env, tail) : Value{};
+    const Value list_val = (*list)(env, tail);
+
+    const auto* obj = func_val.as_object();
+    if (!obj || obj->intrinsic() != kind || !is_list(list_val)) {
+      const auto proc = lambda->eval(env, tail);
+      if (init) {
+        const std::array args{proc, init_val, list_val};
+        return call<Tail>(func_val, args, tail);
+      }
+      const std::array args{proc, list_val};
+      return call<Tail>(func_val, args, tail);
+    }
+
+    BodyRunner run_body{*lambda, env};
+    if (kind == Intrinsic::foldl) {
+      Value acc = init_val;
+      for (const auto* node = list_val.as_object(); node != nullptr;
+           node = static_cast<const Cons*>(node)->cdr.as_object()) {
+        const std::array args{static_cast<const Cons*>(node)->car, acc};
+        acc = run_body(args);
+      }
+      return acc;
+    }
+
+    const auto frame = ValueStack::current().push(list_length(list_val));
+    const auto elements = frame.values();
+    copy_list(list_val, elements);
+    switch (kind) {
+    case Intrinsic::map:
+      for (auto& element : elements) {
+        element = run_body(Values{&element, 1});
+      }
+      return make_list(elements);
+    case Intrinsic::filter: {
+      // Moves the kept elements to the front
+      std::size_t kept = 0;
+      for (const auto& element : elements) {
+        const Value keep = run_body(Values{&element, 1});
+        if (!(keep.is_boolean() && !keep.as_boolean())) {
+          elements[kept++] = element;
+        }
+      }
+      return make_list(elements.first(kept));
+    }
+    default: {
+      Value acc = init_val;
+      for (auto itr = elements.rbegin(); itr != elements.rend(); ++itr) {
+        const std::array args{*itr, acc};
+        acc = run_body(args);
+      }
+      return acc;
+    }
+    }
+  }
+
+  void trace(Tracer& tracer) const override
+  {
+    lambda->trace(tracer);
+    if (init) { init->trace(tracer); }
+    list->trace(tracer);
+  }
+};
+
+// The builtins without side effects, whose applications can run in any order
+constexpr std::array<std::string_view, 23> reorderable_builtins{
+    "+", "-", "*", "/", "<", "<=", ">", ">=", "eq?", "equal?", "not", "and",
+    "or", "number?", "boolean?", "procedural?", "null?", "pair?", "list?",
+    "cons", "car", "cdr", "list"};
+
+[[nodiscard]] auto is_reorderable_builtin(std::string_view name) -> bool
+{
+  return std::ranges::find(reorderable_builtins, name) !=
+         reorderable_builtins.end();
+}
+
+// Whether running an expression has no effects besides raising errors, which
+// holds when it applies nothing but reorderable builtins. Collects the
+// builtins it applies, which the global variables must still hold.
+struct EffectScanner : ExprVisitor {
+  bool pure = true;
+  std::vector<Symbol> builtins;
+
+  void scan(const Expr& expr)
+  {
+    if (pure) { expr.accept(*this); }
+  }
+
+  void visit(const NumberExpr&) override {}
+  void visit(const BooleanExpr&) override {}
+  void visit(const VariableExpr&) override {}
+  // Only applying the procedural would run its body
+  void visit(const LambdaExpr&) override {}
+
+  void visit(const ApplyExpr& expr) override
+  {
+    const auto* func = dynamic_cast<const VariableExpr*>(expr.func);
+    if (!func || !func->address.is_global() ||
+        !is_reorderable_builtin(func->id.name())) {
+      pure = false;
+      return;
+    }
+    if (std::ranges::find(builtins, func->id) == builtins.end()) {
+      builtins.push_back(func->id);
+    }
+    for (const auto* arg : expr.arguments) { scan(*arg); }
+  }
+
+  void visit(const LetExpr& expr) override
+  {
+    for (const auto& binding : expr.bindings) { scan(*binding.expr); }
+    scan(*expr.body);
+  }
+
+  void visit(const IfExpr& expr) override
+  {
+    scan(*expr.cond_expr);
+    scan(*expr.if_expr);
+    scan(*expr.else_expr);
+  }
+};
+
+[[nodiscard]] auto holds_builtin(const Value& value, Symbol id) -> bool
+{
+  const auto* proc = object_cast<BuiltinProc>(value.as_object());
+  return proc && proc->name == id.name();
+}
+
+// An application of map, filter or a fold in a pipeline
+struct PipelineStage {
+  GlobalRef func;
+  Intrinsic kind;
+  // The procedural applied to the elements, which is either a lambda
+  // expression or a builtin
+  std::unique_ptr<const Lambda> lambda;
+  std::optional<GlobalRef> builtin;
+  // The initial value of a fold, or null
+  CompiledPtr init;
+};
+
+constexpr std::size_t max_pipeline_stages = 8;
+
+// Nested applications of map and filter to a list or to an application of
+// range, under an optional fold, such as (foldl f 0 (map g (range 0 n))). The
+// elements pass through all of the applications in a single traversal, so
+// the intermediate lists are never created. The applied procedurals have no
+// effects, so the order in which they run is not observable. When a global
+// variable no longer holds its builtin, or when the traversal raises an
+// error, the applications run one after another as usual instead, which
+// raises the error where it belongs.
+template <bool Tail> struct Pipeline : Node<Pipeline<Tail>> {
+  // From the outermost application to the innermost one
+  std::vector<PipelineStage> stages;
+  // The builtins that the lambda expressions apply
+  std::vector<GlobalRef> builtins;
+  // The arguments of range, or only the list when range is empty
+  std::optional<GlobalRef> range;
+  std::vector<CompiledPtr> source;
+
+  Pipeline(std::vector<PipelineStage> stages_, std::vector<GlobalRef> builtins_,
+           std::optional<GlobalRef> range_, std::vector<CompiledPtr> source_)
+      : stages{MOV(stages_)}, builtins{MOV(builtins_)}, range{MOV(range_)},
+        source{MOV(source_)}
+  {}
+
+  auto eval(const EnvPtr& env, TailCall& tail) const -> Value
+  {
+    // Every application takes three values: the builtin, the procedural it
+    // applies and the initial value of a fold, or else range and its
+    // arguments. They are evaluated in the order of the nested applications,
+    // which evaluate all of them before the innermost one is applied. Creating
+    // the procedurals of lambda expressions has no effects, so they are left
+    // out.
+    const auto frame = ValueStack::current().push(3 * (stages.size() + 1));
+    const auto values = frame.values();
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+      const auto& stage = stages[i];
+      values[3 * i] = stage.func.get(*env);
+      if (stage.builtin) { values[3 * i + 1] = stage.builtin->get(*env); }
+      if (stage.init) { values[3 * i + 2] = (*stage.init)(env, tail); }
+    }
+    const auto source_vals = values.last(3);
+    if (range) {
+      source_vals[0] = range->get(*env);
+      source_vals[1] = (*source[0])(env, tail);
+      source_vals[2] = (*source[1])(env, tail);
+    } else {
+      source_vals[0] = (*source[0])(env, tail);
+    }
+
+    if (holds_builtins(*env, values)) {
+      try {
+        if (auto result = traverse(env, values)) { return MOV(*result); }
+      } catch (const std::runtime_error&) {
+        // Applying the builtins one after another raises the error again
+      }
+    }
+    return apply_stages(env, values, tail);
+  }
+
+private:
+  [[nodiscard]] auto holds_builtins(const Environment& env, Values values) const
+      -> bool
+  {
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+      const auto& stage = stages[i];
+      const auto* obj = values[3 * i].as_object();
+      if (!obj || obj->intrinsic() != stage.kind ||
+          (stage.builtin &&
+           !holds_builtin(values[3 * i + 1], stage.builtin->id()))) {
+        return false;
+      }
+    }
+    if (range) {
+      const auto* obj = values[3 * stages.size()].as_object();
+      if (!obj || obj->intrinsic() != Intrinsic::range) { return false; }
+    }
+    return std::ranges::all_of(builtins, [&](const GlobalRef& builtin) {
+      const auto* value = builtin.find(env);
+      return value && holds_builtin(*value, builtin.id());
+    });
+  }
+
+  // Passes every element of the source through the stages, or returns nullopt
+  // when the arguments of the innermost application are invalid
+  [[nodiscard]] auto traverse(const EnvPtr& env, Values values) const
+      -> std::optional<Value>
+  {
+    const auto source_vals = values.last(3);
+    std::int64_t lower = 0;
+    std::int64_t upper = 0;
+    if (range) {
+      if (!source_vals[1].is_number() || !source_vals[2].is_number()) {
+        return std::nullopt;
+      }
+      lower = to_integer(source_vals[1]);
+      upper = std::max(lower, to_integer(source_vals[2]));
+    } else if (!is_list(source_vals[0])) {
+      return std::nullopt;
+    }
+    const auto for_each_element = [&](auto&& consume) {
+      if (range) {
+        for (auto i = lower; i < upper; ++i) {
+          Value element = Value::integer(i);
+          consume(element);
+        }
+        return;
+      }
+      for (const auto* node = source_vals[0].as_object(); node != nullptr;
+           node = static_cast<const Cons*>(node)->cdr.as_object()) {
+        Value element = static_cast<const Cons*>(node)->car;
+        consume(element);
+      }
+    };
+
+    std::array<std::optional<BodyRunner>, max_pipeline_stages> runners;
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+      if (stages[i].lambda) { runners[i].emplace(*stages[i].lambda, env); }
+    }
+    const auto apply_stage = [&](std::size_t i, Values args) -> Value {
+      if (runners[i]) { return (*runners[i])(args); }
+      return apply_builtin(
+          static_cast<const BuiltinProc&>(*values[3 * i + 1].as_object()),
+          args);
+    };
+
+    // Maps the element through the stages below the fold, innermost first,
+    // and returns whether every filter keeps it
+    const auto& outermost = stages.front();
+    const std::size_t first = outermost.init ? 1 : 0;
+    const auto transform = [&](Value& element) {
+      for (std::size_t i = stages.size(); i-- > first;) {
+        const Value result = apply_stage(i, Values{&element, 1});
+        if (stages[i].kind == Intrinsic::map) {
+          element = result;
+        } else if (result.is_boolean() && !result.as_boolean()) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    if (outermost.kind == Intrinsic::foldl) {
+      Value acc = values[2];
+      for_each_element([&](Value& element) {
+        if (transform(element)) {
+          const std::array args{element, acc};
+          acc = apply_stage(0, args);
+        }
+      });
+      return acc;
+    }
+
+    // Subtracted as unsigned, since the difference may not fit int64
+    const auto length = range ? static_cast<std::size_t>(upper) -
+                                    static_cast<std::size_t>(lower)
+                              : list_length(source_vals[0]);
+    const auto frame = ValueStack::current().push(length);
+    const auto elements = frame.values();
+    std::size_t kept = 0;
+    for_each_element([&](Value& element) {
+      if (transform(element)) { elements[kept++] = element; }
+    });
+    if (outermost.kind != Intrinsic::foldr) {
+      return make_list(elements.first(kept));
+    }
+    Value acc = values[2];
+    for (std::size_t i = kept; i-- > 0;) {
+      const std::array args{elements[i], acc};
+      acc = apply_stage(0, args);
+    }
+    return acc;
+  }
+
+  // Applies the builtins one after another, like the nested applications
+  [[nodiscard]] auto apply_stages(const EnvPtr& env, Values values,
+                                  TailCall& tail) const -> Value
+  {
+    const auto source_vals = values.last(3);
+    Value list =
+        range ? call<false>(source_vals[0], source_vals.subspan(1), tail)
+              : source_vals[0];
+    for (std::size_t i = stages.size(); i-- > 0;) {
+      const auto& stage = stages[i];
+      const Value proc =
+          stage.lambda ? stage.lambda->eval(env, tail) : values[3 * i + 1];
+      const std::array args{proc, stage.init ? values[3 * i + 2] : list, list};
+      const Values arguments{args.data(), stage.init ? 3u : 2u};
+      list = i == 0 ? call<Tail>(values[0], arguments, tail)
+                    : call<false>(values[3 * i], arguments, tail);
+    }
+    return list;
+  }
+
+  void trace(Tracer& tracer) const override
+  {
+    for (const auto& stage : stages) {
+      if (stage.lambda) { stage.lambda->trace(tracer); }
+      if (stage.init) { stage.init->trace(tracer); }
+    }
+    for (const auto& expr : source) { expr->trace(tracer); }
+  }
+};
+
+// The builtins that are fused with the lambda expressions they are applied to
+struct FusableBuiltin {
+  std::string_view name;
+  Intrinsic kind;
+  // The number of arguments of the builtin and of the lambda expression
+  std::size_t arity;
+  std::size_t lambda_arity;
+};
+
+constexpr std::array fusable_builtins{
+    FusableBuiltin{"map", Intrinsic::map, 2, 1},
+    FusableBuiltin{"filter", Intrinsic::filter, 2, 1},
+    FusableBuiltin{"foldl", Intrinsic::foldl, 3, 2},
+    FusableBuiltin{"foldr", Intrinsic::foldr, 3, 2},
+};
+
+// The fusable builtin that an application applies with the right number of
+// arguments, or null
+[[nodiscard]] auto find_fusable_builtin(const ApplyExpr& expr)
+    -> const FusableBuiltin*
+{
+  const auto* variable = dynamic_cast<const VariableExpr*>(expr.func);
+  if (!variable || !variable->address.is_global()) { return nullptr; }
+  const auto builtin = std::ranges::find(
+      fusable_builtins, variable->id.name(), &FusableBuiltin::name);
+  if (builtin == fusable_builtins.end() ||
+      builtin->arity != expr.arguments.size()) {
+    return nullptr;
+  }
+  return &*builtin;
+}
+
+// Whether expr can be applied by a pipeline: a reorderable builtin, or a
+// lambda expression with the given number of parameters whose body has no
+// effects. Adds the builtins that the body applies to builtins.
+[[nodiscard]] auto is_pipeline_function(const Expr& expr, std::size_t arity,
+                                        std::vector<Symbol>& builtins) -> bool
+{
+  if (const auto* variable = dynamic_cast<const VariableExpr*>(&expr)) {
+    return variable->address.is_global() &&
+           is_reorderable_builtin(variable->id.name());
+  }
+  const auto* lambda = dynamic_cast<const LambdaExpr*>(&expr);
+  if (!lambda || lambda->parameters.size() != arity) { return false; }
+  EffectScanner scanner;
+  scanner.scan(*lambda->body);
+  if (!scanner.pure) { return false; }
+  for (const auto id : scanner.builtins) {
+    if (std::ranges::find(builtins, id) == builtins.end()) {
+      builtins.push_back(id);
+    }
+  }
+  return true;
+}
+
+[[nodiscard]] auto is_range_application(const Expr& expr) -> bool
+{
+  const auto* apply = dynamic_cast<const ApplyExpr*>(&expr);
+  const auto* func =
+      apply ? dynamic_cast<const VariableExpr*>(apply->func) : nullptr;
+  return func && func->address.is_global() && func->id.name() == "range" &&
+         apply->arguments.size() == 2;
+}
+
+struct ClosureCompiler : ExprVisitor {
+  CompiledPtr result;
+  // Whether the expression being compiled is in tail position
+  bool tail = true;
+
+  auto compile(const Expr& expr, bool in_tail_position) -> CompiledPtr
+  {
+    const bool saved_tail = tail;
+    tail = in_tail_position;
+    expr.accept(*this);
+    tail = saved_tail;
+    return MOV(result);
+  }
+
+  void visit(const NumberExpr& expr) override
+  {
+    result = std::make_unique<Constant>(Value::number(expr.value));
+  }
+
+  void visit(const BooleanExpr& expr) override
+  {
+    result = std::make_unique<Constant>(expr.value);
+  }
+
+  void visit(const VariableExpr& expr) override
+  {
+    if (expr.address.is_global()) {
+      result = std::make_unique<GlobalVariable>(expr.id);
+    } else {
+      result = std::make_unique<LocalVariable>(expr.address);
+    }
+  }
+
+  template <std::size_t Arity, bool Tail>
+  auto compile_fixed_apply(const ApplyExpr& expr) -> CompiledPtr
+  {
+    auto func = compile(*expr.func, false);
+    std::array<CompiledPtr, Arity> arguments;
+    std::size_t i = 0;
+    for (auto& argument : arguments) {
+      argument = compile(*expr.arguments[i++], false);
+    }
+    return std::make_unique<FixedApply<Arity, Tail>>(MOV(func),
+                                                     MOV(arguments));
+  }
+
+  template <bool Tail> auto compile_apply(const ApplyExpr& expr) -> CompiledPtr
+  {
+    switch (expr.arguments.size()) {
+    case 0:
+      return compile_fixed_apply<0, Tail>(expr);
+    case 1:
+      return compile_fixed_apply<1, Tail>(expr);
+    case 2:
+      return compile_fixed_apply<2, Tail>(expr);
+    case 3:
+      return compile_fixed_apply<3, Tail>(expr);
+    default:
+      break;
+    }
+
+    auto func = compile(*expr.func, false);
+    std::vector<CompiledPtr> arguments;
+    arguments.reserve(expr.arguments.size());
+    for (const auto* arg : expr.arguments) {
+      arguments.push_back(compile(*arg, false));
+    }
+    return std::make_unique<Apply<Tail>>(MOV(func), MOV(arguments));
+  }
+
+  // Compiles an application of a higher-order builtin to a lambda expression
+  // into a loop, or returns null
+  template <bool Tail>
+  auto compile_fused_loop(const ApplyExpr& expr) -> CompiledPtr
+  {
+    const auto* builtin = find_fusable_builtin(expr);
+    const auto* lambda_expr =
+        builtin ? dynamic_cast<const LambdaExpr*>(expr.arguments.front())
+                : nullptr;
+    if (!lambda_expr ||
+        builtin->lambda_arity != lambda_expr->parameters.size()) {
+      return nullptr;
+    }
+
+    auto lambda = std::make_unique<const Lambda>(
+        *lambda_expr,
+        make_ref<CompiledCode>(compile(*lambda_expr->body, true)));
+    auto init =
+        builtin->arity == 3 ? compile(*expr.arguments[1], false) : nullptr;
+    auto list = compile(*expr.arguments.back(), false);
+    return std::make_unique<FusedLoop<Tail>>(
+        static_cast<const VariableExpr&>(*expr.func).id, builtin->kind,
+        MOV(lambda), MOV(init), MOV(list));
+  }
+
+  // Compiles nested applications of fusable builtins into a pipeline, or
+  // returns null when they create no intermediate list
+  template <bool Tail>
+  auto compile_pipeline(const ApplyExpr& expr) -> CompiledPtr
+  {
+    std::vector<const ApplyExpr*> applications;
+    std::vector<Symbol> builtins;
+    const Expr* source_expr = &expr;
+    while (applications.size() < max_pipeline_stages) {
+      const auto* application = dynamic_cast<const ApplyExpr*>(source_expr);
+      const auto* builtin =
+          application ? find_fusable_builtin(*application) : nullptr;
+      // Only the outermost application can be a fold
+      if (!builtin || (!applications.empty() && builtin->arity == 3) ||
+          !is_pipeline_function(*application->arguments.front(),
+                                builtin->lambda_arity, builtins)) {
+        break;
+      }
+      applications.push_back(application);
+      source_expr = application->arguments.back();
+    }
+    const bool from_range = is_range_application(*source_expr);
+    if (applications.size() + (from_range ? 1 : 0) < 2) { return nullptr; }
+
+    std::vector<PipelineStage> stages;
+    stages.reserve(applications.size());
+    for (const auto* application : applications) {
+      const auto& func = static_cast<const VariableExpr&>(*application->func);
+      const auto* builtin = find_fusable_builtin(*application);
+      const auto& function = *application->arguments.front();
+      std::unique_ptr<const Lambda> lambda;
+      std::optional<GlobalRef> builtin_function;
+      if (const auto* lambda_expr =
+              dynamic_cast<const LambdaExpr*>(&function)) {
+        lambda = std::make_unique<const Lambda>(
+            *lambda_expr,
+            make_ref<CompiledCode>(compile(*lambda_expr->body, true)));
+      } else {
+        builtin_function.emplace(
+            static_cast<const VariableExpr&>(function).id);
+      }
+      auto init = builtin->arity == 3
+                      ? compile(*application->arguments[1], false)
+                      : nullptr;
+      stages.push_back(PipelineStage{GlobalRef{func.id}, builtin->kind,
+                                     MOV(lambda), MOV(builtin_function),
+                                     MOV(init)});
+    }
+
+    std::optional<GlobalRef> range;
+    std::vector<CompiledPtr> source;
+    if (from_range) {
+      const auto& range_expr = static_cast<const ApplyExpr&>(*source_expr);
+      range.emplace(static_cast<const VariableExpr&>(*range_expr.func).id);
+      for (const auto* arg : range_expr.arguments) {
+        source.push_back(compile(*arg, false));
+      }
+    } else {
+      source.push_back(compile(*source_expr, false));
+    }
+    return std::make_unique<Pipeline<Tail>>(
+        MOV(stages), std::vector<GlobalRef>(builtins.begin(), builtins.end()),
+        MOV(range), MOV(source));
+  }
+
+  void visit(const ApplyExpr& expr) override
+  {
+    result =
+        tail ? compile_pipeline<true>(expr) : compile_pipeline<false>(expr);
+    if (result) { return; }
+    result = tail ? compile_fused_loop<true>(expr)
+                  : compile_fused_loop<false>(expr);
+    if (result) { return; }
+    result = tail ? compile_apply<true>(expr) : compile_apply<false>(expr);
+  }
+
+  void visit(const LambdaExpr& expr) override
+  {
+    result = std::make_unique<Lambda>(
+        expr, make_ref<CompiledCode>(compile(*expr.body, true)));
+  }
+
+  void visit(const LetExpr& expr) override
+  {
+    std::vector<CompiledPtr> bindings;
+    bindings.reserve(expr.bindings.size());
+    for (const auto& binding : expr.bindings) {
+      bindings.push_back(compile(*binding.expr, false));
+    }
+    auto body = compile(*expr.body, tail);
+    result = std::make_unique<Let>(MOV(bindings), MOV(body));
+  }
+
+  void visit(const IfExpr& expr) override
+  {
+    auto cond = compile(*expr.cond_expr, false);
+    auto then = compile(*expr.if_expr, tail);
+    auto otherwise = compile(*expr.else_expr, tail);
+    result = std::make_unique<If>(MOV(cond), MOV(then), MOV(otherwise));
+  }
+};
+
+} // anonymous namespace
+
+auto GlobalRef::get(const Environment& env) const -> const Value&
+{
+  if (const auto* val = find(env); val) { return *val; }
+  throw std::runtime_error(
+      fmt::format("ReferenceError: {} is not defined", id_));
+}
+
+CompiledCode::CompiledCode(std::unique_ptr<const CompiledExpr> root_)
+    : root{MOV(root_)}
+{}
+
+CompiledCode::~CompiledCode() = default;
+
+void CompiledCode::trace(Tracer& tracer) const
+{
+  if (root) { root->trace(tracer); }
+}
+
+void CompiledCode::clear_references() { root = nullptr; }
+
+auto compile_closures(const Expr& expr) -> Ref<const CompiledCode>
+{
+  return make_ref<CompiledCode>(ClosureCompiler{}.compile(expr, true));
+}
+
+namespace {
+
+// Runs the body of a compiled procedural until its next call in tail position
+auto run_body(const Proc& proc, const EnvPtr& env, TailCall& tail) -> Value
+{
+  return proc.native != nullptr ? proc.native(env, tail)
+                                : (*proc.code->root)(env, tail);
+}
+
+// Makes the calls in tail position that compiled code left in tail
+auto run_tail_calls(Value result, TailCall& tail) -> Value
+{
+  while (tail.callee.is_object()) {
+    const Value callee = std::exchange(tail.callee, Value{});
+    const EnvPtr callee_env = MOV(tail.env);
+    const auto& proc = static_cast<const Proc&>(*callee.as_object());
+    result = run_body(proc, callee_env, tail);
+  }
+  return result;
+}
+
+} // anonymous namespace
+
+auto run_closures(const CompiledCode& code, const EnvPtr& env) -> Value
+{
+  const NativeCallGuard guard;
+  TailCall tail;
+  return run_tail_calls((*code.root)(env, tail), tail);
+}
+
+auto run_closures(const Proc& proc, const EnvPtr& env) -> Value
+{
+  const NativeCallGuard guard;
+  TailCall tail;
+  return run_tail_calls(run_body(proc, env, tail), tail);
+}
+
+auto run_closures(NativeFunction function, const EnvPtr& env) -> Value
+{
+  const NativeCallGuard guard;
+  TailCall tail;
+  return run_tail_calls(function(env, tail), tail);
+}
+
+auto call_compiled(const Value& func, Values args) -> Value
+{
+  TailCall unused;
+  return call<false>(func, args, unused);
+}
+
+auto tail_call_compiled(const Value& func, Values args, TailCall& tail)
+    -> Value
+{
+  return call<true>(func, args, tail);
+}
@@ -0,0 +1,113 @@
+#ifndef EASYLISP_CLOSURE_COMPILER_HPP
+#define EASYLISP_CLOSURE_COMPILER_HPP
+
+#include <memory>
+
+#include "ast.hpp"
+#include "environment.hpp"
+#include "value.hpp"
+
+/**
+ * @brief An expression compiled into a tree of native callables
+ *
+ * Every node is specialized for its kind of expression when it is compiled,
+ * so running it takes a single indirect call per node instead of a visitor
+ * double dispatch. Compiled closures are also the runtime of the C++ code that
+ * easylisp emits ahead of time.
+ */
+struct CompiledExpr;
+
+/**
+ * @brief The compiled closures of a lambda body or a toplevel expression
+ *
+ * Like the chunks of the virtual machine, compiled code lives on the heap, so
+ * that the procedurals created from a lambda expression share it without
+ * atomic reference counting, and the collector sees the objects that its
+ * closures refer to.
+ */
+struct CompiledCode : HeapObject {
+  std::unique_ptr<const CompiledExpr> root;
+
+  explicit CompiledCode(std::unique_ptr<const CompiledExpr> root_);
+  ~CompiledCode() override;
+  CompiledCode(const CompiledCode&) = delete;
+  auto operator=(const CompiledCode&) & -> CompiledCode& = delete;
+  CompiledCode(CompiledCode&&) = delete;
+  auto operator=(CompiledCode&&) & -> CompiledCode& = delete;
+
+  void trace(Tracer& tracer) const override;
+  void clear_references() override;
+};
+
+/**
+ * @brief A call in tail position, which compiled code leaves for run_closures
+ * to make instead of calling the procedural itself
+ */
+struct TailCall {
+  // Keeps the procedural and its code alive until the call
+  Value callee;
+  EnvPtr env;
+};
+
+using NativeFunction = Proc::NativeFunction;
+
+/**
+ * @brief A global variable referenced from compiled code, which caches its
+ * lookup
+ */
+class GlobalRef {
+  Symbol id_;
+  mutable GlobalCache cache_;
+
+public:
+  explicit GlobalRef(Symbol id) : id_{id} {}
+
+  [[nodiscard]] auto id() const -> Symbol { return id_; }
+
+  /// @brief Returns the value of the variable, or null if it is not defined
+  [[nodiscard]] auto find(const Environment& env) const -> const Value*
+  {
+    return env.find_global(id_, cache_);
+  }
+
+  [[nodiscard]] auto get(const Environment& env) const -> const Value&;
+};
+
+/**
+ * @brief Compiles an expression into compiled closures
+ */
+[[nodiscard]] auto compile_closures(const Expr& expr)
+    -> Ref<const CompiledCode>;
+
+/**
+ * @brief Runs a compiled expression in the environment env
+ *
+ * Calls in tail position run in constant native stack.
+ */
+[[nodiscard]] auto run_closures(const CompiledCode& code, const EnvPtr& env)
+    -> Value;
+
+/**
+ * @brief Runs the body of a compiled procedural in the environment env
+ */
+[[nodiscard]] auto run_closures(const Proc& proc, const EnvPtr& env) -> Value;
+
+/**
+ * @brief Runs a toplevel expression that was compiled ahead of time into C++
+ */
+[[nodiscard]] auto run_closures(NativeFunction function, const EnvPtr& env)
+    -> Value;
+
+/**
+ * @brief Calls func from compiled code
+ */
+[[nodiscard]] auto call_compiled(const Value& func, Values args) -> Value;
+
+/**
+ * @brief Calls func from compiled code in tail position, which leaves calls of
+ * compiled procedurals in tail
+ */
+[[nodiscard]] auto tail_call_compiled(const Value& func, Values args,
+                                      TailCall& tail) -> Value;
+
+#endif // EASYLISP_CLOSURE_COMPILER_HPP
@@ -0,0 +1,115 @@
+#include "compiler.hpp"
+
+#include <stdexcept>
+
+namespace {
+
+struct Compiler : ExprVisitor {
+  Chunk& chunk;
+  // Whether the expression being compiled is in tail position
+  bool tail = true;
+
+  explicit Compiler(Chunk& chunk_) : chunk{chunk_} {}
+
+  auto emit(OpCode op, std::size_t operand = 0) -> std::size_t
+  {
+    chunk.code.push_back({op, 0, static_cast<std::uint32_t>(operand)});
+    return chunk.code.size() - 1;
+  }
+
+  void patch_jump(std::size_t jump_index)
+  {
+    chunk.code[jump_index].operand =
+        static_cast<std::uint32_t>(chunk.code.size());
+  }
+
+  void emit_constant(Value value)
+  {
+    chunk.constants.push_back(MOV(value));
+    emit(OpCode::constant, chunk.constants.size() - 1);
+  }
+
+  void compile_expr(const Expr& expr, bool in_tail_position)
+  {
+    const bool saved_tail = tail;
+    tail = in_tail_position;
+    expr.accept(*this);
+    tail = saved_tail;
+  }
+
+  void visit(const NumberExpr& expr) override
+  {
+    emit_constant(Value::number(expr.value));
+  }
+
+  void visit(const BooleanExpr& expr) override { emit_constant(expr.value); }
+
+  void visit(const VariableExpr& expr) override
+  {
+    if (expr.address.is_global()) {
+      chunk.names.push_back(expr.id);
+      chunk.global_caches.emplace_back();
+      emit(OpCode::load_global, chunk.names.size() - 1);
+      return;
+    }
+
+    if (expr.address.depth > std::numeric_limits<std::uint16_t>::max()) {
+      throw std::runtime_error{"Compile error: scopes are nested too deeply"};
+    }
+    chunk.code.push_back({OpCode::load_local,
+                          static_cast<std::uint16_t>(expr.address.depth),
+                          expr.address.slot});
+  }
+
+  void visit(const ApplyExpr& expr) override
+  {
+    compile_expr(*expr.func, false);
+    for (const auto& arg : expr.arguments) { compile_expr(*arg, false); }
+    emit(tail ? OpCode::tail_call : OpCode::call, expr.arguments.size());
+  }
+
+  void visit(const LambdaExpr& expr) override
+  {
+    auto child = make_ref<Chunk>();
+    child->parameters.assign(expr.parameters.begin(), expr.parameters.end());
+    child->captures.assign(expr.captures.begin(), expr.captures.end());
+    child->body = expr.shared_body();
+    Compiler{*child}.compile_expr(*expr.body, true);
+    child->code.push_back({OpCode::return_});
+
+    chunk.chunks.push_back(MOV(child));
+    emit(OpCode::make_closure, chunk.chunks.size() - 1);
+  }
+
+  void visit(const LetExpr& expr) override
+  {
+    for (const auto& binding : expr.bindings) {
+      compile_expr(*binding.expr, false);
+    }
+    emit(OpCode::enter_let, expr.bindings.size());
+    compile_expr(*expr.body, tail);
+    // Returning leaves every let frame anyway
+    if (!tail) { emit(OpCode::exit_let); }
+  }
+
+  void visit(const IfExpr& expr) override
+  {
+    compile_expr(*expr.cond_expr, false);
+    const auto else_jump = emit(OpCode::jump_if_false);
+    compile_expr(*expr.if_expr, tail);
+    const auto end_jump = emit(OpCode::jump);
+    patch_jump(else_jump);
+    compile_expr(*expr.else_expr, tail);
+    patch_jump(end_jump);
+  }
+};
+
+} // anonymous namespace
+
+auto compile(const Expr& expr) -> Ref<const Chunk>
+{
+  auto chunk = make_ref<Chunk>();
+  Compiler{*chunk}.compile_expr(expr, true);
+  chunk->code.push_back({OpCode::return_});
+  return chunk;
+}
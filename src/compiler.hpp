@@ -0,0 +1,13 @@
+#ifndef EASYLISP_COMPILER_HPP
+#define EASYLISP_COMPILER_HPP
+
+#include "ast.hpp"
+#include "bytecode.hpp"
+
+/**
+ * @brief Compiles an expression into a chunk of bytecode for the virtual
+ * machine
+ */
+[[nodiscard]] auto compile(const Expr& expr) -> Ref<const Chunk>;
+
+#endif // EASYLISP_COMPILER_HPP
@@ -0,0 +1,376 @@
+#include "cpp_emitter.hpp"
+#include "file_util.hpp"
+#include "parser.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fmt/format.h>
+
+namespace {
+
+[[nodiscard]] auto cpp_string(std::string_view str) -> std::string
+{
+  std::string result = "\"";
+  for (const char c : str) {
+    if (c == '"' || c == '\\') { result += '\\'; }
+    result += c;
+  }
+  return result + '"';
+}
+
+[[nodiscard]] auto cpp_symbol(Symbol symbol) -> std::string
+{
+  return fmt::format("Symbol{{{}}}", cpp_string(symbol.name()));
+}
+
+[[nodiscard]] auto cpp_double(double value) -> std::string
+{
+  if (std::isnan(value)) { return "std::numeric_limits<double>::quiet_NaN()"; }
+  if (std::isinf(value)) {
+    return value > 0 ? "std::numeric_limits<double>::infinity()"
+                     : "-std::numeric_limits<double>::infinity()";
+  }
+  // The shortest representation that reads back as the same double
+  auto literal = fmt::format("{}", value);
+  if (literal.find_first_of(".e") == std::string::npos) { literal += ".0"; }
+  return literal;
+}
+
+[[nodiscard]] auto cpp_number(const Number& number) -> std::string
+{
+  if (const auto* value = std::get_if<double>(&number)) {
+    return fmt::format("Value{{{}}}", cpp_double(*value));
+  }
+  const auto integer = std::get<std::int64_t>(number);
+  // The literal of the smallest integer would overflow before it is negated
+  if (integer == std::numeric_limits<std::int64_t>::min()) {
+    return "Value::integer(std::numeric_limits<std::int64_t>::min())";
+  }
+  return fmt::format("Value::integer({})", integer);
+}
+
+[[nodiscard]] auto cpp_address(LexicalAddress address) -> std::string
+{
+  return fmt::format("LexicalAddress{{{}, {}}}", address.depth, address.slot);
+}
+
+constexpr std::string_view prologue = R"(// Generated by easylisp --emit-cpp
+#include <array>
+#include <limits>
+
+#include <fmt/format.h>
+
+#include "closure_compiler.hpp"
+#include "environment.hpp"
+#include "interpreter.hpp"
+
+)";
+
+class CppEmitter {
+  std::string declarations_;
+  std::string definitions_;
+  std::string main_;
+  std::unordered_map<Symbol, std::string> globals_;
+  std::size_t function_count_ = 0;
+
+public:
+  void emit_program(const Program& program);
+
+  /// @brief Emits a function that evaluates body, and returns its index
+  auto emit_function(const Expr& body) -> std::size_t;
+
+  /// @brief Emits a lambda expression, and returns the index of its body
+  auto emit_lambda(const LambdaExpr& expr) -> std::size_t;
+
+  /// @brief The name of the reference to a global variable
+  auto global(Symbol id) -> const std::string&;
+
+  [[nodiscard]] auto source() const -> std::string
+  {
+    return fmt::format("{}namespace {{\n\n{}\n{}}} // anonymous namespace\n\n"
+                       "auto main() -> int\n"
+                       "try {{\n"
+                       "  const auto global = "
+                       "make_ref<Environment>(Environment::create_global);\n"
+                       "{}"
+                       "}} catch (const std::exception& e) {{\n"
+                       "  fmt::print(\"{{}}\\n\", e.what());\n"
+                       "}}\n",
+                       prologue, declarations_, definitions_, main_);
+  }
+};
+
+// Emits the body of a function, which evaluates an expression in env
+class FunctionEmitter : ExprVisitor {
+  CppEmitter& emitter_;
+  std::string code_;
+  int indent_ = 1;
+  std::string env_ = "env";
+  std::size_t temp_count_ = 0;
+  std::size_t env_count_ = 0;
+  // Whether the expression being emitted is in tail position, where it
+  // returns its value
+  bool tail_ = true;
+  // The C++ expression of the value of an expression not in tail position
+  std::string result_;
+
+public:
+  explicit FunctionEmitter(CppEmitter& emitter) : emitter_{emitter} {}
+
+  [[nodiscard]] auto emit(const Expr& body) -> std::string
+  {
+    return_value(body);
+    return MOV(code_);
+  }
+
+private:
+  void line(std::string_view text)
+  {
+    code_.append(static_cast<std::size_t>(indent_) * 2, ' ');
+    code_ += text;
+    code_ += '\n';
+  }
+
+  [[nodiscard]] auto new_temp() -> std::string
+  {
+    return fmt::format("t{}", temp_count_++);
+  }
+
+  [[nodiscard]] auto value_of(const Expr& expr) -> std::string
+  {
+    const bool saved_tail = std::exchange(tail_, false);
+    expr.accept(*this);
+    tail_ = saved_tail;
+    return MOV(result_);
+  }
+
+  void return_value(const Expr& expr)
+  {
+    const bool saved_tail = std::exchange(tail_, true);
+    expr.accept(*this);
+    tail_ = saved_tail;
+  }
+
+  // Produces the value of an expression without side effects
+  void produce(std::string value)
+  {
+    if (tail_) {
+      line(fmt::format("return {};", value));
+    } else {
+      result_ = MOV(value);
+    }
+  }
+
+  // Produces a value through a temporary, which fixes the order of evaluation
+  void produce_in_temp(std::string_view value)
+  {
+    if (tail_) {
+      line(fmt::format("return {};", value));
+      return;
+    }
+    auto temp = new_temp();
+    line(fmt::format("const Value {} = {};", temp, value));
+    result_ = MOV(temp);
+  }
+
+  // Emits expr in tail position or assigns it to the temporary target
+  void emit_into(const Expr& expr, const std::string& target)
+  {
+    if (tail_) {
+      return_value(expr);
+    } else {
+      line(fmt::format("{} = {};", target, value_of(expr)));
+    }
+  }
+
+  void visit(const NumberExpr& expr) override
+  {
+    produce(cpp_number(expr.value));
+  }
+
+  void visit(const BooleanExpr& expr) override
+  {
+    produce(expr.value ? "Value{true}" : "Value{false}");
+  }
+
+  void visit(const VariableExpr& expr) override
+  {
+    if (expr.address.is_global()) {
+      produce_in_temp(
+          fmt::format("{}.get(*{})", emitter_.global(expr.id), env_));
+    } else {
+      produce(fmt::format("{}->lookup({})", env_, cpp_address(expr.address)));
+    }
+  }
+
+  void visit(const ApplyExpr& expr) override
+  {
+    const auto func = value_of(*expr.func);
+    std::vector<std::string> args;
+    args.reserve(expr.arguments.size());
+    for (const auto* arg : expr.arguments) { args.push_back(value_of(*arg)); }
+
+    const auto args_array =
+        fmt::format("std::array<Value, {}>{{{}}}", args.size(),
+                    fmt::join(args, ", "));
+    if (tail_) {
+      line(fmt::format("return tail_call_compiled({}, {}, tail);", func,
+                       args_array));
+    } else {
+      produce_in_temp(fmt::format("call_compiled({}, {})", func, args_array));
+    }
+  }
+
+  void visit(const LambdaExpr& expr) override
+  {
+    const auto index = emitter_.emit_lambda(expr);
+    produce_in_temp(fmt::format(
+        "Value::make<Proc>(parameters_{0}, nullptr, "
+        "capture_environment(captures_{0}, {1}), &function_{0})",
+        index, env_));
+  }
+
+  void visit(const LetExpr& expr) override
+  {
+    std::string target;
+    if (!tail_) {
+      target = new_temp();
+      line(fmt::format("Value {};", target));
+    }
+    line("{");
+    ++indent_;
+
+    std::vector<std::string> values;
+    values.reserve(expr.bindings.size());
+    for (const auto& binding : expr.bindings) {
+      values.push_back(value_of(*binding.expr));
+    }
+    const auto bindings = new_temp();
+    line(fmt::format("const std::array<Value, {}> {}{{{}}};", values.size(),
+                     bindings, fmt::join(values, ", ")));
+    auto let_env = fmt::format("env{}", env_count_++);
+    line(fmt::format("const EnvPtr {} = make_ref<Environment>({}, {});",
+                     let_env, env_, bindings));
+
+    const auto saved_env = std::exchange(env_, MOV(let_env));
+    emit_into(*expr.body, target);
+    env_ = saved_env;
+
+    --indent_;
+    line("}");
+    result_ = MOV(target);
+  }
+
+  void visit(const IfExpr& expr) override
+  {
+    const auto cond = value_of(*expr.cond_expr);
+    std::string target;
+    if (!tail_) {
+      target = new_temp();
+      line(fmt::format("Value {};", target));
+    }
+
+    line(fmt::format("if (as_condition({})) {{", cond));
+    ++indent_;
+    emit_into(*expr.if_expr, target);
+    --indent_;
+    line("} else {");
+    ++indent_;
+    emit_into(*expr.else_expr, target);
+    --indent_;
+    line("}");
+    result_ = MOV(target);
+  }
+};
+
+auto CppEmitter::global(Symbol id) -> const std::string&
+{
+  auto [itr, inserted] = globals_.try_emplace(id);
+  if (inserted) {
+    itr->second = fmt::format("global_{}", globals_.size() - 1);
+    declarations_ += fmt::format("const GlobalRef {}{{{}}};\n", itr->second,
+                                 cpp_symbol(id));
+  }
+  return itr->second;
+}
+
+auto CppEmitter::emit_function(const Expr& body) -> std::size_t
+{
+  const auto index = function_count_++;
+  declarations_ += fmt::format(
+      "auto function_{0}(const EnvPtr& env, TailCall& tail) -> Value;\n",
+      index);
+
+  const auto code = FunctionEmitter{*this}.emit(body);
+  definitions_ += fmt::format("auto function_{}([[maybe_unused]] const EnvPtr& "
+                              "env,\n"
+                              "    [[maybe_unused]] TailCall& tail) -> Value\n"
+                              "{{\n{}}}\n\n",
+                              index, code);
+  return index;
+}
+
+auto CppEmitter::emit_lambda(const LambdaExpr& expr) -> std::size_t
+{
+  std::vector<std::string> parameters;
+  for (const auto parameter : expr.parameters) {
+    parameters.push_back(cpp_symbol(parameter));
+  }
+  std::vector<std::string> captures;
+  for (const auto& capture : expr.captures) {
+    captures.push_back(fmt::format("Capture{{{}, {}}}",
+                                   cpp_symbol(capture.variable),
+                                   cpp_address(capture.address)));
+  }
+
+  const auto index = emit_function(*expr.body);
+  declarations_ += fmt::format(
+      "const std::array<Symbol, {1}> parameters_{0}{{{2}}};\n"
+      "const std::array<Capture, {3}> captures_{0}{{{4}}};\n",
+      index, parameters.size(), fmt::join(parameters, ", "), captures.size(),
+      fmt::join(captures, ", "));
+  return index;
+}
+
+void CppEmitter::emit_program(const Program& program)
+{
+  for (const auto& toplevel : program) {
+    std::visit(
+        overloaded{
+            [&](const ExprPtr& expr) {
+              main_ += fmt::format(
+                  "  static_cast<void>(run_closures(&function_{}, global));\n",
+                  emit_function(*expr));
+            },
+            [&](const Definition& definition) {
+              main_ += fmt::format(
+                  "  global->add({}, run_closures(&function_{}, global));\n",
+                  cpp_symbol(definition.var),
+                  emit_function(*definition.expr));
+            },
+            [&](const Require& require) {
+              std::ifstream file{
+                  fmt::format("{}.easylisp", require.module_name)};
+              if (!file.is_open()) {
+                throw std::runtime_error{
+                    fmt::format("Runtime error: Cannot open module {}",
+                                require.module_name)};
+              }
+              emit_program(parse(file_to_string(file)));
+            }},
+        toplevel);
+  }
+}
+
+} // anonymous namespace
+
+auto emit_cpp(const Program& program) -> std::string
+{
+  CppEmitter emitter;
+  emitter.emit_program(program);
+  return emitter.source();
+}
@@ -0,0 +1,19 @@
+#ifndef EASYLISP_CPP_EMITTER_HPP
+#define EASYLISP_CPP_EMITTER_HPP
+
+#include <string>
+
+#include "ast.hpp"
+
+/**
+ * @brief Translates a program into a C++ translation unit that runs it
+ *
+ * Lambda expressions become C++ functions, and if and let expressions become
+ * native control flow. The translation unit is linked against the common
+ * library, which provides the values and the builtins, and runs procedurals
+ * as compiled closures. Required modules are read and translated along with
+ * the program.
+ */
+[[nodiscard]] auto emit_cpp(const Program& program) -> std::string;
+
+#endif // EASYLISP_CPP_EMITTER_HPP
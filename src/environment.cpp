@@ -1,14 +1,79 @@
 #include "environment.hpp"
 
-auto Environment::find(const std::string& var) const -> const Value*
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <utility>
+
+namespace {
+
+[[nodiscard]] auto allocate_slots(Values values) -> std::span<Value>
+{
+  if (values.empty()) { return {}; }
+  auto* slots = static_cast<Value*>(
+      Heap::current().allocate(values.size() * sizeof(Value)));
+  std::uninitialized_copy(values.begin(), values.end(), slots);
+  return {slots, values.size()};
+}
+
+void free_slots(std::span<Value> slots) noexcept
+{
+  if (slots.empty()) { return; }
+  std::destroy(slots.begin(), slots.end());
+  Heap::deallocate(slots.data(), slots.size() * sizeof(Value));
+}
+
+} // anonymous namespace
+
+Environment::Environment(EnvPtr parent, Values slots)
+    : slots_{allocate_slots(slots)}, parent_(MOV(parent)),
+      global_{parent_ ? parent_->global_ : this}
+{}
+
+Environment::~Environment()
+{
+  free_slots(slots_);
+  if (parent_ == nullptr) { ++global_version_; }
+}
+
+void Environment::assign(Values values)
+{
+  assert(values.size() == slots_.size());
+  std::ranges::copy(values, slots_.begin());
+}
+
+auto Environment::find(Symbol var) const -> const Value*
 {
   auto itr = bindings_.find(var);
   if (itr != bindings_.end()) { return &itr->second; }
   return parent_ ? parent_->find(var) : nullptr;
 }
 
+auto Environment::find_global(Symbol var) const -> const Value*
+{
+  auto itr = global_->bindings_.find(var);
+  return itr != global_->bindings_.end() ? &itr->second : nullptr;
+}
+
+void Environment::add(Symbol variable, Value value)
+{
+  bindings_.insert_or_assign(variable, MOV(value));
+  ++global_version_;
+}
+
+void Environment::trace(Tracer& tracer) const
+{
+  for (const auto& [_, value] : bindings_) { tracer(value.as_object()); }
+  for (const auto& value : slots_) { tracer(value.as_object()); }
+  tracer(parent_);
+}
 
-void Environment::add(std::string variable, Value value)
+void Environment::clear_references()
 {
-  bindings_.insert_or_assign(MOV(variable), MOV(value));
-}
\ No newline at end of file
+  // A global environment may stay alive after forgetting its definitions
+  if (parent_ == nullptr) { ++global_version_; }
+  bindings_.clear();
+  free_slots(std::exchange(slots_, {}));
+  parent_ = nullptr;
+  global_ = this;
+}
@@ -3,21 +3,82 @@
 
 #include "value.hpp"
 #include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
-class Environment {
-  std::unordered_map<std::string, Value> bindings_;
+class Environment : public HeapObject {
+  // Changes whenever a global environment is destroyed, gets a definition or
+  // forgets its definitions, which invalidates every GlobalCache
+  static inline thread_local std::uint64_t global_version_ = 1;
+
+  // Allocated from the memory resource of the heap that the environment lives
+  // in, like the environment itself
+  std::pmr::unordered_map<Symbol, Value> bindings_{Heap::current().resource()};
+  // Variables of a lambda or let frame, indexed by their lexical address.
+  // They live on the garbage collected heap next to the environment.
+  std::span<Value> slots_;
   EnvPtr parent_ = nullptr;
+  // The outermost environment of the parent chain, which holds the globals
+  const Environment* global_ = this;
 
 public:
   static constexpr struct create_global_t {
   } create_global{};
   explicit Environment(create_global_t);
-  explicit Environment(EnvPtr parent) : parent_(MOV(parent)) {}
+  explicit Environment(EnvPtr parent)
+      : parent_(MOV(parent)), global_{parent_ ? parent_->global_ : this}
+  {}
+  Environment(EnvPtr parent, Values slots);
+  ~Environment() override;
+  Environment(const Environment&) = delete;
+  auto operator=(const Environment&) & -> Environment& = delete;
+  Environment(Environment&&) = delete;
+  auto operator=(Environment&&) & -> Environment& = delete;
+
+  [[nodiscard]] auto find(Symbol var) const -> const Value*;
+  [[nodiscard]] auto find_global(Symbol var) const -> const Value*;
+  void add(Symbol variable, Value value);
+
+  /**
+   * @brief Finds a global variable, reusing the result of the previous lookup
+   * through cache when possible
+   */
+  [[nodiscard]] auto find_global(Symbol var, GlobalCache& cache) const
+      -> const Value*
+  {
+    if (cache.env == global_ && cache.version == global_version_) {
+      return cache.value;
+    }
+
+    const Value* value = global_->find_global(var);
+    if (value != nullptr) { cache = {global_, value, global_version_}; }
+    return value;
+  }
+
+  /**
+   * @brief Replaces the variables of a frame with values of the same number,
+   * which is only safe while nothing else refers to the environment
+   */
+  void assign(Values values);
+
+  void trace(Tracer& tracer) const override;
+  void clear_references() override;
+
+  [[nodiscard]] auto parent() const -> const EnvPtr& { return parent_; }
+
+  [[nodiscard]] auto global() const -> const Environment& { return *global_; }
 
-  [[nodiscard]] auto find(const std::string& var) const -> const Value*;
-  void add(std::string variable, Value value);
+  [[nodiscard]] auto lookup(LexicalAddress address) const -> const Value&
+  {
+    const Environment* env = this;
+    for (auto depth = address.depth; depth > 0; --depth) {
+      env = env->parent_.get();
+    }
+    return env->slots_[address.slot];
+  }
 };
 
 #endif // EASYLISP_ENVIRONMENT_HPP
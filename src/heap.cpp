@@ -0,0 +1,268 @@
+#include "heap.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <new>
+
+namespace {
+
+// Marks the objects that are reachable from outside the heap
+constexpr auto reachable = std::numeric_limits<std::uint32_t>::max();
+
+// The heap of an interpreter that is running, if any
+thread_local Heap* active_heap = nullptr;
+
+// Owns the heap of a thread, which is orphaned when the thread exits, since
+// values in static storage or in other thread-local objects may still refer
+// to it
+class ThreadHeap {
+  std::unique_ptr<Heap> heap_ = std::make_unique<Heap>();
+
+public:
+  ThreadHeap() = default;
+  ~ThreadHeap() { Heap::orphan(MOV(heap_)); }
+  ThreadHeap(const ThreadHeap&) = delete;
+  auto operator=(const ThreadHeap&) & -> ThreadHeap& = delete;
+  ThreadHeap(ThreadHeap&&) = delete;
+  auto operator=(ThreadHeap&&) & -> ThreadHeap& = delete;
+
+  [[nodiscard]] auto get() const noexcept -> Heap& { return *heap_; }
+};
+
+} // anonymous namespace
+
+HeapObject::~HeapObject()
+{
+  if (next_ != nullptr) { Heap::owner(this).untrack(*this); }
+}
+
+auto HeapObject::operator new(std::size_t size) -> void*
+{
+  return Heap::current().allocate(size);
+}
+
+void HeapObject::operator delete(void* ptr, std::size_t size) noexcept
+{
+  Heap::deallocate(ptr, size);
+}
+
+Heap::Activation::Activation(Heap& heap)
+    : saved_{std::exchange(active_heap, &heap)}
+{}
+
+Heap::Activation::~Activation() { active_heap = saved_; }
+
+Heap::Heap(std::pmr::memory_resource* resource) : resource_{resource}
+{
+  tracked_.prev_ = &tracked_;
+  tracked_.next_ = &tracked_;
+}
+
+Heap::~Heap()
+{
+  collect();
+  if (!is_empty()) {
+    // The objects would free their memory into a heap that is gone
+    std::fputs("easylisp: a heap was destroyed while it still held objects\n",
+               stderr);
+    std::abort();
+  }
+  release();
+  tracked_.prev_ = nullptr;
+  tracked_.next_ = nullptr;
+}
+
+auto Heap::current() -> Heap&
+{
+  if (active_heap != nullptr) { return *active_heap; }
+  thread_local const ThreadHeap heap;
+  return heap.get();
+}
+
+void Heap::orphan(std::unique_ptr<Heap> heap)
+{
+  heap->collect();
+  if (heap->is_empty()) { return; }
+  heap->orphaned_ = true;
+  static_cast<void>(heap.release());
+}
+
+auto Heap::is_empty() const noexcept -> bool
+{
+  return large_objects_ == 0 &&
+         std::ranges::all_of(cell_counts_,
+                             [](const auto& cells) { return cells.live == 0; });
+}
+
+void Heap::free_if_orphaned(Heap& heap) noexcept
+{
+  if (heap.orphaned_ && heap.is_empty()) { delete &heap; }
+}
+
+auto Heap::allocate(std::size_t size) -> void*
+{
+  size = cell_size(size);
+  if (size > max_small_size) {
+    auto* header = ::new (resource_->allocate(sizeof(Header) + size,
+                                              alignment)) Header{this};
+    ++large_objects_;
+    return header + 1;
+  }
+
+  auto& cells = cell_counts_[size / alignment - 1];
+  ++cells.live;
+  auto& free_list = free_lists_[size / alignment - 1];
+  if (free_list != nullptr) {
+    --cells.free;
+    return std::exchange(free_list, free_list->next);
+  }
+
+  if (static_cast<std::size_t>(bump_end_ - bump_) < size) {
+    auto* block =
+        static_cast<std::byte*>(resource_->allocate(block_size, block_size));
+    blocks_.push_back(block);
+    ::new (block) Header{this};
+    bump_ = block + sizeof(Header);
+    bump_end_ = block + block_size;
+  }
+  return std::exchange(bump_, bump_ + size);
+}
+
+void Heap::deallocate(void* ptr, std::size_t size) noexcept
+{
+  size = cell_size(size);
+  if (size > max_small_size) {
+    auto* header = static_cast<Header*>(ptr) - 1;
+    Heap& heap = *header->heap;
+    heap.resource_->deallocate(header, sizeof(Header) + size, alignment);
+    --heap.large_objects_;
+    free_if_orphaned(heap);
+    return;
+  }
+
+  Heap& heap = owner(ptr);
+  auto& cells = heap.cell_counts_[size / alignment - 1];
+  --cells.live;
+  ++cells.free;
+  auto& free_list = heap.free_lists_[size / alignment - 1];
+  free_list = ::new (ptr) FreeSlot{free_list};
+  free_if_orphaned(heap);
+}
+
+auto Heap::owner(const void* ptr) noexcept -> Heap&
+{
+  const auto block = reinterpret_cast<std::uintptr_t>(ptr) & ~(block_size - 1);
+  return *reinterpret_cast<const Header*>(block)->heap;
+}
+
+auto Heap::release() -> bool
+{
+  if (object_count_ != 0 || large_objects_ != 0) { return false; }
+  for (std::byte* block : blocks_) {
+    resource_->deallocate(block, block_size, block_size);
+  }
+  blocks_.clear();
+  bump_ = nullptr;
+  bump_end_ = nullptr;
+  free_lists_ = {};
+  cell_counts_ = {};
+  return true;
+}
+
+auto Heap::stats() const -> HeapStats
+{
+  HeapStats stats;
+  stats.large_objects = large_objects_;
+  stats.blocks = blocks_.size();
+  for (std::size_t i = 0; i < cell_counts_.size(); ++i) {
+    const auto& cells = cell_counts_[i];
+    if (cells.live == 0 && cells.free == 0) { continue; }
+    stats.size_classes.push_back(
+        {.cell_size = (i + 1) * alignment, .live = cells.live,
+         .free = cells.free});
+  }
+  return stats;
+}
+
+void Heap::track(const HeapObject& object)
+{
+  auto& tracked = const_cast<HeapObject&>(object);
+  tracked.prev_ = tracked_.prev_;
+  tracked.next_ = &tracked_;
+  tracked_.prev_->next_ = &tracked;
+  tracked_.prev_ = &tracked;
+  ++object_count_;
+
+  if (++allocations_ >= collection_threshold_) {
+    collect();
+    allocations_ = 0;
+    collection_threshold_ = std::max(min_collection_threshold, object_count_);
+  }
+}
+
+void Heap::untrack(HeapObject& object) noexcept
+{
+  object.prev_->next_ = object.next_;
+  object.next_->prev_ = object.prev_;
+  object.prev_ = nullptr;
+  object.next_ = nullptr;
+  --object_count_;
+}
+
+auto Heap::collect() -> std::size_t
+{
+  // Subtracts the references from tracked objects. Whatever remains comes
+  // from outside the heap and makes an object a root.
+  for (auto* obj = tracked_.next_; obj != &tracked_; obj = obj->next_) {
+    obj->gc_refs_ = obj->ref_count_;
+  }
+  Tracer tracer{children_};
+  for (auto* obj = tracked_.next_; obj != &tracked_; obj = obj->next_) {
+    children_.clear();
+    obj->trace(tracer);
+    for (const auto* child : children_) {
+      if (child->next_ != nullptr && &owner(child) == this) {
+        --child->gc_refs_;
+      }
+    }
+  }
+
+  for (auto* obj = tracked_.next_; obj != &tracked_; obj = obj->next_) {
+    if (obj->gc_refs_ > 0) {
+      obj->gc_refs_ = reachable;
+      worklist_.push_back(obj);
+    }
+  }
+  while (!worklist_.empty()) {
+    const auto* obj = worklist_.back();
+    worklist_.pop_back();
+    children_.clear();
+    obj->trace(tracer);
+    for (const auto* child : children_) {
+      if (child->next_ != nullptr && &owner(child) == this &&
+          child->gc_refs_ != reachable) {
+        child->gc_refs_ = reachable;
+        worklist_.push_back(child);
+      }
+    }
+  }
+
+  // Everything else is only referenced by garbage. Holding an extra reference
+  // to the garbage while breaking its cycles keeps it from being freed by
+  // reference counting halfway through.
+  children_.clear();
+  garbage_.clear();
+  for (auto* obj = tracked_.next_; obj != &tracked_; obj = obj->next_) {
+    if (obj->gc_refs_ != reachable) {
+      ++obj->ref_count_;
+      garbage_.push_back(obj);
+    }
+  }
+  for (auto* obj : garbage_) { obj->clear_references(); }
+  for (auto* obj : garbage_) { HeapObject::release(obj); }
+  const auto freed = garbage_.size();
+  garbage_.clear();
+  return freed;
+}
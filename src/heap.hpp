@@ -0,0 +1,377 @@
+#ifndef EASYLISP_HEAP_HPP
+#define EASYLISP_HEAP_HPP
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+
+class Heap;
+class HeapObject;
+class Value;
+template <typename T> class Ref;
+
+/**
+ * @brief Creates a heap object and a reference to it
+ */
+template <typename T, typename... Args>
+[[nodiscard]] auto make_ref(Args&&... args) -> Ref<T>;
+
+/**
+ * @brief Collects the heap objects that a heap object refers to
+ */
+class Tracer {
+  std::vector<const HeapObject*>& children_;
+
+public:
+  explicit Tracer(std::vector<const HeapObject*>& children)
+      : children_{children}
+  {}
+
+  void operator()(const HeapObject* object)
+  {
+    if (object != nullptr) { children_.push_back(object); }
+  }
+
+  template <typename T> void operator()(const Ref<T>& ref)
+  {
+    (*this)(ref.object_);
+  }
+};
+
+/**
+ * @brief The base of everything that lives on the garbage collected heap
+ *
+ * Heap objects are reference counted by the handles (Value and Ref) that refer
+ * to them. Reference counting alone cannot free cycles, such as the global
+ * environment and the procedurals defined in it, so the heap also keeps track
+ * of its objects and collects unreachable cycles from time to time.
+ */
+class HeapObject {
+  friend class Heap;
+  friend class Value;
+  template <typename T> friend class Ref;
+
+  // The list of tracked objects of the heap
+  HeapObject* prev_ = nullptr;
+  HeapObject* next_ = nullptr;
+  // The number of handles that refer to this object
+  mutable std::uint32_t ref_count_ = 0;
+  // Scratch space of the collector
+  mutable std::uint32_t gc_refs_ = 0;
+
+  static void retain(const HeapObject* object) noexcept
+  {
+    if (object != nullptr) { ++object->ref_count_; }
+  }
+
+  static void release(const HeapObject* object) noexcept
+  {
+    if (object != nullptr && --object->ref_count_ == 0) { delete object; }
+  }
+
+public:
+  HeapObject() = default;
+  virtual ~HeapObject();
+  HeapObject(const HeapObject&) = delete;
+  auto operator=(const HeapObject&) & -> HeapObject& = delete;
+  HeapObject(HeapObject&&) = delete;
+  auto operator=(HeapObject&&) & -> HeapObject& = delete;
+
+  [[nodiscard]] static auto operator new(std::size_t size) -> void*;
+  static void operator delete(void* ptr, std::size_t size) noexcept;
+
+  /**
+   * @brief Reports every heap object this object holds a reference to
+   */
+  virtual void trace(Tracer& tracer) const = 0;
+
+  /**
+   * @brief Drops every reference this object holds, which breaks the cycles
+   * of garbage
+   */
+  virtual void clear_references() = 0;
+};
+
+/**
+ * @brief A reference counted pointer to a heap object
+ *
+ * Ref works with incomplete types, so that heap objects can refer to each
+ * other before they are all defined.
+ */
+template <typename T> class Ref {
+  friend class Tracer;
+  template <typename U> friend class Ref;
+  template <typename U, typename... Args>
+  friend auto make_ref(Args&&... args) -> Ref<U>;
+
+  HeapObject* object_ = nullptr;
+
+  explicit Ref(std::remove_const_t<T>* object) noexcept : object_{object}
+  {
+    HeapObject::retain(object_);
+  }
+
+public:
+  Ref() noexcept = default;
+  Ref(std::nullptr_t) noexcept {}
+
+  template <typename U>
+    requires std::convertible_to<U*, T*>
+  Ref(const Ref<U>& other) noexcept : object_{other.object_}
+  {
+    HeapObject::retain(object_);
+  }
+
+  ~Ref() { HeapObject::release(object_); }
+  Ref(const Ref& other) noexcept : object_{other.object_}
+  {
+    HeapObject::retain(object_);
+  }
+  auto operator=(const Ref& other) & noexcept -> Ref&
+  {
+    Ref copy{other};
+    std::swap(object_, copy.object_);
+    return *this;
+  }
+  Ref(Ref&& other) noexcept : object_{std::exchange(other.object_, nullptr)}
+  {}
+  auto operator=(Ref&& other) & noexcept -> Ref&
+  {
+    Ref moved{MOV(other)};
+    std::swap(object_, moved.object_);
+    return *this;
+  }
+
+  /// @brief Creates another reference to an object that is already referenced
+  [[nodiscard]] static auto share(T& object) noexcept -> Ref
+  {
+    return Ref{const_cast<std::remove_const_t<T>*>(&object)};
+  }
+
+  [[nodiscard]] auto get() const noexcept -> T*
+  {
+    return static_cast<T*>(object_);
+  }
+  auto operator*() const noexcept -> T& { return *get(); }
+  auto operator->() const noexcept -> T* { return get(); }
+  explicit operator bool() const noexcept { return object_ != nullptr; }
+
+  /// @brief Whether this is the only reference to a heap object
+  [[nodiscard]] auto is_unique() const noexcept -> bool
+  {
+    return object_ != nullptr && object_->ref_count_ == 1;
+  }
+
+  [[nodiscard]] friend auto operator==(const Ref& ref, std::nullptr_t) noexcept
+      -> bool
+  {
+    return ref.object_ == nullptr;
+  }
+};
+
+/**
+ * @brief The number of cells of a heap, to find out what a program allocates
+ */
+struct HeapStats {
+  /// @brief The cells of one size, which all objects of that size share,
+  /// whatever their type
+  struct SizeClass {
+    std::size_t cell_size = 0;
+    std::size_t live = 0; ///< Cells that hold an object
+    std::size_t free = 0; ///< Freed cells on the free list
+  };
+
+  // Only the size classes that were ever allocated
+  std::vector<SizeClass> size_classes;
+  // Live allocations that are too large for a size class
+  std::size_t large_objects = 0;
+  std::size_t blocks = 0;
+};
+
+/**
+ * @brief A garbage collected heap
+ *
+ * Objects are bump allocated from large blocks, and freed memory is recycled
+ * through free lists segregated by size. Since the handles count references,
+ * the collector does not need to know the roots: every reference that does
+ * not come from another heap object, such as the global environment of an
+ * interpreter or the stack of the virtual machine, keeps its object alive.
+ *
+ * Every thread has a heap of its own, and an interpreter can run on a heap of
+ * its own as well, which takes its memory from a memory resource. Blocks are
+ * aligned to their size and start with a pointer to their heap, so memory is
+ * always freed into the heap that allocated it, whichever heap is current.
+ *
+ * A heap must not be destroyed while it still holds objects, which aborts the
+ * program. An owner that cannot wait for the objects to go away, such as an
+ * interpreter whose values outlive it, orphans the heap instead.
+ */
+class Heap {
+  friend class HeapObject;
+
+public:
+  /// @brief The size of the largest allocations that share blocks, which heap
+  /// objects must not exceed
+  static constexpr std::size_t max_small_size = 256;
+
+private:
+  static constexpr std::size_t alignment = alignof(std::max_align_t);
+  static constexpr std::size_t block_size = 64 * 1024;
+  // Collect when the number of allocations since the last collection reaches
+  // this or the number of objects that survived it, whichever is larger
+  static constexpr std::size_t min_collection_threshold = 10'000;
+
+  struct FreeSlot {
+    FreeSlot* next;
+  };
+
+  // Precedes the memory of every block and of every large allocation
+  struct alignas(alignment) Header {
+    Heap* heap;
+  };
+
+  std::pmr::memory_resource* resource_;
+  std::vector<std::byte*> blocks_;
+  std::byte* bump_ = nullptr;
+  std::byte* bump_end_ = nullptr;
+  std::array<FreeSlot*, max_small_size / alignment> free_lists_{};
+  // The number of live and free cells of every size class
+  std::array<HeapStats::SizeClass, max_small_size / alignment> cell_counts_{};
+  std::size_t large_objects_ = 0;
+  // Whether the heap destroys itself once its last allocation is freed
+  bool orphaned_ = false;
+
+  // The sentinel of the circular list of tracked objects
+  struct Sentinel : HeapObject {
+    void trace(Tracer&) const override {}
+    void clear_references() override {}
+  } tracked_;
+  std::size_t object_count_ = 0;
+  std::size_t allocations_ = 0;
+  std::size_t collection_threshold_ = min_collection_threshold;
+  // Scratch space of collect, kept to avoid allocating during collections
+  std::vector<const HeapObject*> children_;
+  std::vector<const HeapObject*> worklist_;
+  std::vector<HeapObject*> garbage_;
+
+public:
+  /**
+   * @brief Makes a heap the current heap of this thread and restores the
+   * previous one on destruction
+   */
+  class Activation {
+    Heap* saved_;
+
+  public:
+    explicit Activation(Heap& heap);
+    ~Activation();
+    Activation(const Activation&) = delete;
+    auto operator=(const Activation&) & -> Activation& = delete;
+    Activation(Activation&&) = delete;
+    auto operator=(Activation&&) & -> Activation& = delete;
+  };
+
+  explicit Heap(
+      std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+  ~Heap();
+  Heap(const Heap&) = delete;
+  auto operator=(const Heap&) & -> Heap& = delete;
+  Heap(Heap&&) = delete;
+  auto operator=(Heap&&) & -> Heap& = delete;
+
+  /**
+   * @brief The heap that new objects are allocated from
+   *
+   * Outside of an activation, every thread has a heap of its own.
+   */
+  [[nodiscard]] static auto current() -> Heap&;
+
+  /**
+   * @brief Destroys a heap once it holds no objects anymore, which may be
+   * right away
+   *
+   * Until then, the memory resource of the heap must stay alive.
+   */
+  static void orphan(std::unique_ptr<Heap> heap);
+
+  /// @brief The memory resource that the heap takes its blocks from
+  [[nodiscard]] auto resource() const noexcept -> std::pmr::memory_resource*
+  {
+    return resource_;
+  }
+
+  [[nodiscard]] auto allocate(std::size_t size) -> void*;
+
+  /**
+   * @brief Frees memory of size bytes into the heap that allocated it
+   */
+  static void deallocate(void* ptr, std::size_t size) noexcept;
+
+  /**
+   * @brief Hands a newly created object over to the collector
+   *
+   * The object must already be referenced by a handle, since tracking may
+   * trigger a collection.
+   */
+  void track(const HeapObject& object);
+
+  /**
+   * @brief Frees every object that is only reachable from garbage cycles
+   * @return The number of freed objects
+   */
+  auto collect() -> std::size_t;
+
+  /// @brief The number of live objects tracked by the heap
+  [[nodiscard]] auto object_count() const noexcept -> std::size_t
+  {
+    return object_count_;
+  }
+
+  [[nodiscard]] auto stats() const -> HeapStats;
+
+  /**
+   * @brief Gives every block back to the memory resource at once, which only
+   * happens when the heap holds no objects anymore
+   * @return Whether the blocks were released
+   */
+  auto release() -> bool;
+
+  /// @brief The size of the cells that hold objects of size bytes
+  [[nodiscard]] static constexpr auto cell_size(std::size_t size) noexcept
+      -> std::size_t
+  {
+    return (size + alignment - 1) / alignment * alignment;
+  }
+
+private:
+  // The heap of a small allocation or heap object
+  [[nodiscard]] static auto owner(const void* ptr) noexcept -> Heap&;
+
+  void untrack(HeapObject& object) noexcept;
+
+  // Whether no allocation of the heap is alive
+  [[nodiscard]] auto is_empty() const noexcept -> bool;
+
+  // Destroys an orphaned heap after its last allocation was freed
+  static void free_if_orphaned(Heap& heap) noexcept;
+};
+
+template <typename T, typename... Args>
+auto make_ref(Args&&... args) -> Ref<T>
+{
+  static_assert(sizeof(T) <= Heap::max_small_size,
+                "Heap objects must fit into the cells of a block");
+  Ref<T> ref{new std::remove_const_t<T>(FWD(args)...)};
+  Heap::current().track(*ref);
+  return ref;
+}
+
+#endif // EASYLISP_HEAP_HPP
@@ -1,151 +1,312 @@
 #include "interpreter.hpp"
+#include "closure_compiler.hpp"
+#include "compiler.hpp"
 #include "environment.hpp"
 #include "file_util.hpp"
 #include "parser.hpp"
 #include "value.hpp"
+#include "value_stack.hpp"
+#include "vm.hpp"
 
+#include <cstdint>
 #include <fstream>
 #include <stdexcept>
 
 namespace {
 
-auto eval_args(const std::vector<ExprPtr>& arg_exprs, const EnvPtr& env)
-    -> std::vector<Value>
-{
-  std::vector<Value> args;
-  args.reserve(arg_exprs.size());
-  for (const ExprPtr& arg : arg_exprs) { args.push_back(eval(*arg, env)); }
-  return args;
-}
+// The number of nested native calls on this thread and their limit
+thread_local std::size_t native_call_depth = 0;
+thread_local std::size_t max_native_call_depth = default_max_call_depth;
+// The address of the outermost native call on the native stack
+thread_local std::uintptr_t native_stack_base = 0;
+
+// How much of the native stack nested calls may use, which leaves room for
+// builtins and error handling below the default stack size of a thread
+#ifdef _WIN32
+constexpr std::uintptr_t native_stack_budget = 512 * 1024;
+#else
+constexpr std::uintptr_t native_stack_budget = 4 * 1024 * 1024;
+#endif
+
+} // anonymous namespace
 
-[[nodiscard]] auto apply_expr(const ApplyExpr& expr, const EnvPtr& env) -> Value
+NativeCallGuard::NativeCallGuard()
 {
-  return ::apply(eval(*expr.func, env), eval_args(expr.arguments, env));
+  const char marker = 0;
+  const auto address = reinterpret_cast<std::uintptr_t>(&marker);
+  if (native_call_depth == 0) { native_stack_base = address; }
+  if (native_call_depth >= max_native_call_depth) {
+    throw std::runtime_error{
+        fmt::format("Runtime error: maximum recursion depth of {} exceeded",
+                    max_native_call_depth)};
+  }
+  // The stack grows down
+  if (native_stack_base - address > native_stack_budget) {
+    throw std::runtime_error{
+        fmt::format("Runtime error: maximum recursion depth exceeded, the "
+                    "native stack ran out after {} nested calls",
+                    native_call_depth)};
+  }
+  ++native_call_depth;
 }
 
-} // anonymous namespace
+NativeCallGuard::~NativeCallGuard() { --native_call_depth; }
 
-struct ObjectApplier : ObjectVisitor {
-  Value result;
-  Values args;
+NativeCallGuard::Limit::Limit(std::size_t max_call_depth)
+    : saved_{std::exchange(max_native_call_depth, max_call_depth)}
+{}
 
-  explicit ObjectApplier(Values args_) : args{args_} {}
+NativeCallGuard::Limit::~Limit() { max_native_call_depth = saved_; }
 
-  void visit(const BuiltinProc& proc) override
-  {
-    result = proc.native_func(args);
+auto bind_arguments(const Proc& proc, Values args) -> EnvPtr
+{
+  if (proc.parameters.size() != args.size()) {
+    throw std::runtime_error(fmt::format(
+        "Type error: arity mismatch\n"
+        "the expected number of arguments does not match the given number\n"
+        "  expected: {}, given: {}",
+        args.size(), proc.parameters.size()));
   }
 
-  void visit(const Proc& proc) override
-  {
-    if (proc.parameters.size() != args.size()) {
-      throw std::runtime_error(fmt::format(
-          "Type error: arity mismatch\n"
-          "the expected number of arguments does not match the given number\n"
-          "  expected: {}, given: {}",
-          args.size(), proc.parameters.size()));
-    }
+  return make_ref<Environment>(proc.env, args);
+}
 
-    auto apply_env = std::make_shared<Environment>(proc.env);
-    for (std::size_t i = 0; i < proc.parameters.size(); ++i) {
-      apply_env->add(proc.parameters[i], args[i]);
-    }
-    result = eval(*proc.body, apply_env);
+auto capture_environment(std::span<const Capture> captures,
+                         const EnvPtr& env) -> EnvPtr
+{
+  auto global = EnvPtr::share(env->global());
+  if (captures.empty()) { return global; }
+
+  const auto frame = ValueStack::current().push(captures.size());
+  const auto values = frame.values();
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    values[i] = env->lookup(captures[i].address);
   }
+  return make_ref<Environment>(MOV(global), values);
+}
 
-  [[noreturn]] static void apply_to_cons()
-  {
-    throw std::runtime_error{"Type error: cannot apply to cons cells"};
+auto lookup_variable(const VariableExpr& expr, const Environment& env)
+    -> const Value&
+{
+  if (!expr.address.is_global()) { return env.lookup(expr.address); }
+
+  if (const auto* val = env.find_global(expr.id, expr.cache); val) {
+    return *val;
   }
+  throw std::runtime_error(
+      fmt::format("ReferenceError: {} is not defined", expr.id));
+}
 
-  void visit(const Cons&) override { apply_to_cons(); }
-};
+auto as_condition(const Value& cond_val) -> bool
+{
+  if (!cond_val.is_boolean()) {
+    throw std::runtime_error{
+        fmt::format("Type error: {} is not a boolean. The condition of an if "
+                    "expression must be a boolean.",
+                    to_string(cond_val))};
+  }
+  return cond_val.as_boolean();
+}
 
 [[nodiscard]] auto apply(const Value& func, Values args) -> Value
 {
-  return std::visit(
-      [&](auto&& f) -> Value {
-        using T = std::remove_cvref_t<decltype(f)>;
-        if constexpr (std::is_same_v<T, ObjectPtr>) {
-          ObjectApplier visitor{args};
-          f->accept(visitor);
-          return visitor.result;
-        } else {
-          throw std::runtime_error{
-              fmt::format("Type error: Cannot apply to {}!", to_string(func))};
-        }
-      },
-      func);
+  const auto* obj = func.as_object();
+  if (obj) {
+    switch (obj->type()) {
+    case ObjectType::builtin_proc:
+      return apply_builtin(static_cast<const BuiltinProc&>(*obj), args);
+    case ObjectType::proc: {
+      const auto& proc = static_cast<const Proc&>(*obj);
+      auto apply_env = bind_arguments(proc, args);
+      if (proc.chunk) { return execute(*proc.chunk, MOV(apply_env)); }
+      if (proc.is_compiled()) { return run_closures(proc, apply_env); }
+      return eval(*proc.body, apply_env);
+    }
+    case ObjectType::cons:
+      throw std::runtime_error{"Type error: cannot apply to cons cells"};
+    case ObjectType::sequence:
+      throw std::runtime_error{"Type error: cannot apply to sequences"};
+    case ObjectType::boxed_integer:
+      break;
+    }
+  }
+  throw std::runtime_error{
+      fmt::format("Type error: Cannot apply to {}!", to_string(func))};
 }
 
+/**
+ * @brief Evaluates a single expression
+ *
+ * Instead of recursing, the evaluator hands expressions in tail position back
+ * to eval as tail_expr, to be evaluated in tail_env (or env if tail_env is
+ * null).
+ */
 struct Evaluator : ExprVisitor {
   Value result;
   const EnvPtr& env;
 
-  explicit Evaluator(const EnvPtr& env_) : env{env_} {}
+  const Expr* tail_expr = nullptr;
+  EnvPtr tail_env;
+  // Keeps the body of a procedural alive when we leave the procedural
+  ExprPtr tail_body;
 
-  void visit(const NumberExpr& number) override { result = number.value; }
+  explicit Evaluator(const EnvPtr& env_) : env{env_} {}
 
-  void visit(const ApplyExpr& expr) override { result = apply_expr(expr, env); }
+  void visit(const NumberExpr& number) override
+  {
+    result = Value::number(number.value);
+  }
 
-  void visit(const VariableExpr& expr) override
+  void visit(const ApplyExpr& expr) override
   {
-    if (const auto* val = env->find(expr.id); val) {
-      result = *val;
+    const Value func = eval(*expr.func, env);
+
+    const auto frame = ValueStack::current().push(expr.arguments.size());
+    const auto args = frame.values();
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      args[i] = eval(*expr.arguments[i], env);
+    }
+
+    const auto* obj = func.as_object();
+    if (obj && obj->intrinsic() != Intrinsic::none) {
+      result = apply_builtin(static_cast<const BuiltinProc&>(*obj), args);
       return;
     }
 
-    throw std::runtime_error(
-        fmt::format("ReferenceError: {} is not defined", expr.id));
+    const auto* proc = object_cast<Proc>(obj);
+    if (proc && !proc->chunk && !proc->is_compiled()) {
+      tail_env = bind_arguments(*proc, args);
+      tail_body = proc->body;
+      tail_expr = tail_body.get();
+      return;
+    }
+    result = ::apply(func, args);
+  }
+
+  void visit(const VariableExpr& expr) override
+  {
+    result = lookup_variable(expr, *env);
   }
 
   void visit(const LambdaExpr& expr) override
   {
-    result = std::make_shared<Proc>(expr.parameters, expr.body, env);
+    result = Value::make<Proc>(expr.parameters, expr.shared_body(),
+                               capture_environment(expr.captures, env));
   }
 
   void visit(const LetExpr& expr) override
   {
-    std::vector<Value> binding_vals;
-    binding_vals.reserve(expr.bindings.size());
-    std::ranges::transform(
-        expr.bindings, std::back_inserter(binding_vals),
-        [&](const Binding& binding) { return eval(*binding.expr, env); });
-    auto body_env = std::make_shared<Environment>(env);
+    const auto frame = ValueStack::current().push(expr.bindings.size());
+    const auto binding_vals = frame.values();
     for (std::size_t i = 0; i < binding_vals.size(); ++i) {
-      body_env->add(expr.bindings[i].variable, binding_vals[i]);
+      binding_vals[i] = eval(*expr.bindings[i].expr, env);
     }
-    result = eval(*expr.body, body_env);
+    tail_env = make_ref<Environment>(env, binding_vals);
+    tail_expr = expr.body;
   }
 
   void visit(const BooleanExpr& expr) override { result = expr.value; }
 
   void visit(const IfExpr& expr) override
   {
-    auto cond_val = eval(*expr.cond_expr, env);
-    const bool* cond = std::get_if<bool>(&cond_val);
-    if (!cond) {
-      throw std::runtime_error{
-          fmt::format("Type error: {} is not a boolean. The condition of an if "
-                      "expression must be a boolean.",
-                      to_string(cond_val))};
-    }
-
-    auto& branch = *cond ? *expr.if_expr : *expr.else_expr;
-    result = eval(branch, env);
+    const bool cond = as_condition(eval(*expr.cond_expr, env));
+    tail_expr = cond ? expr.if_expr : expr.else_expr;
   }
 };
 
 auto eval(const Expr& expr, const EnvPtr& env) -> Value
 {
-  Evaluator evaluator{env};
-  expr.accept(evaluator);
-  return evaluator.result;
+  const NativeCallGuard guard;
+  const Expr* current_expr = &expr;
+  const EnvPtr* current_env = &env;
+  EnvPtr tail_env;
+  ExprPtr tail_body;
+
+  // Runs in constant native stack for expressions in tail position
+  while (true) {
+    Evaluator evaluator{*current_env};
+    current_expr->accept(evaluator);
+    if (evaluator.tail_expr == nullptr) { return MOV(evaluator.result); }
+
+    current_expr = evaluator.tail_expr;
+    if (evaluator.tail_body) { tail_body = MOV(evaluator.tail_body); }
+    if (evaluator.tail_env) {
+      tail_env = MOV(evaluator.tail_env);
+      current_env = &tail_env;
+    }
+  }
+}
+
+Interpreter::Interpreter() : Interpreter{InterpreterOptions{}} {}
+
+Interpreter::Interpreter(InterpreterOptions options)
+    : options_{options},
+      heap_{options.memory_resource != nullptr
+                ? std::make_unique<Heap>(options.memory_resource)
+                : nullptr}
+{
+  const Heap::Activation activation{heap()};
+  static_cast<void>(global_env());
+}
+
+Interpreter::~Interpreter()
+{
+  {
+    const Heap::Activation activation{heap()};
+    // The global environment and the procedurals defined in it form cycles
+    global_env_ = nullptr;
+    heap().collect();
+  }
+  // The values that the interpreter returned still free their objects into
+  // its heap, which then outlives the interpreter until they are gone
+  if (heap_ != nullptr) { Heap::orphan(MOV(heap_)); }
+}
+
+auto Interpreter::reset() -> bool
+{
+  const Heap::Activation activation{heap()};
+  // Forgetting the definitions breaks their cycles, so reference counting
+  // frees them without tracing the heap. Only objects that are still alive
+  // afterwards need a collection to find out whether they are garbage.
+  if (global_env_ != nullptr) { global_env_->clear_references(); }
+  global_env_ = nullptr;
+  if (heap().object_count() != 0) { heap().collect(); }
+  return heap().release();
+}
+
+auto Interpreter::parse(std::string_view source) const -> Program
+{
+  const Heap::Activation activation{heap()};
+  return ::parse(source);
+}
+
+auto Interpreter::global_env() -> const Ref<Environment>&
+{
+  if (global_env_ == nullptr) {
+    global_env_ = make_ref<Environment>(Environment::create_global);
+  }
+  return global_env_;
+}
+
+auto Interpreter::evaluate(const Expr& expr) -> Value
+{
+  const ValueStack::Activation activation{value_stack_};
+  const NativeCallGuard::Limit limit{options_.max_call_depth};
+  switch (options_.engine) {
+  case Engine::vm:
+    return execute(*compile(expr), global_env(), options_.max_call_depth);
+  case Engine::closure:
+    return run_closures(*compile_closures(expr), global_env());
+  case Engine::tree_walker:
+    break;
+  }
+  return eval(expr, global_env());
 }
 
 void Interpreter::add_definition(const Definition& definition)
 {
-  global_env_->add(definition.var, eval(*definition.expr, global_env_));
+  const Heap::Activation activation{heap()};
+  global_env()->add(definition.var, evaluate(*definition.expr));
 }
 
 void Interpreter::require_module(const Require& require)
@@ -154,15 +315,30 @@ void Interpreter::require_module(const Require& require)
   if (!file.is_open())
     throw std::runtime_error{fmt::format("Runtime error: Cannot open module {}",
                                          require.module_name)};
+  const Heap::Activation activation{heap()};
   interpret(parse(file_to_string(file)));
 }
 
 auto Interpreter::interpret_toplevel(const Toplevel& toplevel)
     -> std::optional<Value>
+{
+  const Heap::Activation activation{heap()};
+  // Required modules are optimized when they are interpreted
+  if (options_.optimization == OptimizationLevel::O0 ||
+      std::holds_alternative<Require>(toplevel)) {
+    return run_toplevel(toplevel);
+  }
+  return run_toplevel(
+      optimize(Program{toplevel}, *global_env(), options_.optimization)
+          .front());
+}
+
+auto Interpreter::run_toplevel(const Toplevel& toplevel)
+    -> std::optional<Value>
 {
   return std::visit( //
       overloaded{[this](const ExprPtr& expr) {
-                   return std::optional{eval(*expr, global_env_)};
+                   return std::optional{evaluate(*expr)};
                  },
                  [this](const Definition& definition) -> std::optional<Value> {
                    add_definition(definition);
@@ -177,5 +353,14 @@ auto Interpreter::interpret_toplevel(const Toplevel& toplevel)
 
 void Interpreter::interpret(const Program& program)
 {
-  for (const auto& toplevel : program) { interpret_toplevel(toplevel); }
+  const Heap::Activation activation{heap()};
+  if (options_.optimization == OptimizationLevel::O0) {
+    for (const auto& toplevel : program) { run_toplevel(toplevel); }
+    return;
+  }
+  // Optimizes the whole program at once to see every definition in it
+  for (const auto& toplevel :
+       optimize(program, *global_env(), options_.optimization)) {
+    run_toplevel(toplevel);
+  }
 }
\ No newline at end of file
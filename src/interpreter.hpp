@@ -1,25 +1,176 @@
 #ifndef EASYEASYLISP_HPP
 #define EASYEASYLISP_HPP
 
+#include <memory>
+#include <memory_resource>
 #include <optional>
 
 #include "ast.hpp"
 #include "environment.hpp"
+#include "optimizer.hpp"
 #include "value.hpp"
+#include "value_stack.hpp"
+#include "vm.hpp"
 
 [[nodiscard]] auto eval(const Expr& expr, const EnvPtr& env) -> Value;
 [[nodiscard]] auto apply(const Value& func, Values args) -> Value;
 
+/**
+ * @brief Calls a builtin, running it inline when it is an intrinsic
+ */
+[[nodiscard]] auto apply_builtin(const BuiltinProc& proc, Values args)
+    -> Value;
+
+/**
+ * @brief Creates the environment of an application of proc to args
+ */
+[[nodiscard]] auto bind_arguments(const Proc& proc, Values args) -> EnvPtr;
+
+/**
+ * @brief Creates the environment of a closure, which holds the captured
+ * variables, looked up in env
+ */
+[[nodiscard]] auto capture_environment(std::span<const Capture> captures,
+                                       const EnvPtr& env) -> EnvPtr;
+
+/**
+ * @brief Finds the value of a variable expression in env
+ */
+[[nodiscard]] auto lookup_variable(const VariableExpr& expr,
+                                   const Environment& env) -> const Value&;
+
+/**
+ * @brief Checks that the condition of an if expression is a boolean
+ */
+[[nodiscard]] auto as_condition(const Value& cond_val) -> bool;
+
+/**
+ * @brief Counts a nested call of an engine that recurses on the native stack
+ *
+ * The tree walker and the compiled closures nest native calls for calls that
+ * are not in tail position. Nesting deeper than the call depth limit of the
+ * running interpreter raises the same runtime_error as the virtual machine,
+ * and so does coming close to the end of the native stack.
+ */
+class NativeCallGuard {
+public:
+  NativeCallGuard();
+  ~NativeCallGuard();
+  NativeCallGuard(const NativeCallGuard&) = delete;
+  auto operator=(const NativeCallGuard&) & -> NativeCallGuard& = delete;
+  NativeCallGuard(NativeCallGuard&&) = delete;
+  auto operator=(NativeCallGuard&&) & -> NativeCallGuard& = delete;
+
+  /**
+   * @brief Sets the call depth limit of native calls on this thread, and
+   * restores the previous one on destruction
+   */
+  class Limit {
+    std::size_t saved_;
+
+  public:
+    explicit Limit(std::size_t max_call_depth);
+    ~Limit();
+    Limit(const Limit&) = delete;
+    auto operator=(const Limit&) & -> Limit& = delete;
+    Limit(Limit&&) = delete;
+    auto operator=(Limit&&) & -> Limit& = delete;
+  };
+};
+
+/// @brief The execution engine used by an interpreter
+enum class Engine {
+  tree_walker, ///< Walks the syntax tree directly
+  vm,          ///< Compiles to bytecode and runs on a virtual machine
+  closure,     ///< Compiles to a tree of specialized native closures
+};
+
+struct InterpreterOptions {
+  Engine engine = Engine::tree_walker;
+  // The maximum number of nested procedural calls
+  std::size_t max_call_depth = default_max_call_depth;
+  OptimizationLevel optimization = OptimizationLevel::O0;
+  // Where the interpreter allocates its objects, their environments and the
+  // programs it parses from, in a heap of its own. By default, the interpreter
+  // shares the heap of its thread. The names and native functions of builtins
+  // and the instructions that the vm and closure engines compile still use
+  // the global operator new.
+  std::pmr::memory_resource* memory_resource = nullptr;
+};
+
 class Interpreter {
-  std::shared_ptr<Environment> global_env_ =
-      std::make_shared<Environment>(Environment::create_global);
+  InterpreterOptions options_;
+  // The heap of the interpreter, if it does not share the heap of its thread
+  std::unique_ptr<Heap> heap_;
+  Ref<Environment> global_env_;
+  // Holds the arguments of calls while the interpreter is running
+  ValueStack value_stack_;
 
 public:
+  Interpreter();
+  explicit Interpreter(InterpreterOptions options);
+  /**
+   * @brief Frees the definitions of the interpreter, and its heap if it has
+   * one of its own
+   *
+   * When values that the interpreter returned or programs that it parsed are
+   * still alive, its heap stays alive until they are gone, and so must its
+   * memory resource.
+   */
+  ~Interpreter();
+  Interpreter(const Interpreter&) = delete;
+  auto operator=(const Interpreter&) & -> Interpreter& = delete;
+  Interpreter(Interpreter&&) = delete;
+  auto operator=(Interpreter&&) & -> Interpreter& = delete;
+
+  /**
+   * @brief Parses a program into the heap of the interpreter, so that its
+   * syntax tree is allocated from the memory resource of the interpreter too
+   */
+  [[nodiscard]] auto parse(std::string_view source) const -> Program;
+
   void add_definition(const Definition& definition);
   void require_module(const Require& require);
 
   auto interpret_toplevel(const Toplevel& toplevel) -> std::optional<Value>;
   void interpret(const Program& program);
+
+  /**
+   * @brief Forgets every definition, and gives the memory of the heap of the
+   * interpreter back to its memory resource
+   *
+   * Forgetting the definitions frees them by reference counting, and the
+   * blocks of the heap and of the syntax trees go back to the resource at
+   * once, so an interpreter with a heap of its own resets without tracing its
+   * objects. Afterwards the interpreter holds no memory of its resource until
+   * it is used again, when it creates its builtins anew, so a
+   * std::pmr::monotonic_buffer_resource can be released in between.
+   *
+   * The memory is only given back when no value that the interpreter returned
+   * and no program that it parsed is alive anymore, and when no other
+   * interpreter shares the heap; finding that out takes a collection.
+   * Procedurals that the interpreter returned forget the definitions too.
+   *
+   * @return Whether the memory was given back
+   */
+  auto reset() -> bool;
+
+  /// @brief The cells of the heap that the interpreter allocates from, which
+  /// the interpreters of a thread share unless they have a memory resource
+  [[nodiscard]] auto heap_stats() const -> HeapStats { return heap().stats(); }
+
+private:
+  [[nodiscard]] auto heap() const -> Heap&
+  {
+    return heap_ != nullptr ? *heap_ : Heap::current();
+  }
+
+  // The global environment, which is created anew on first use after a
+  // reset. Must be called while the heap of the interpreter is active.
+  [[nodiscard]] auto global_env() -> const Ref<Environment>&;
+
+  [[nodiscard]] auto evaluate(const Expr& expr) -> Value;
+  auto run_toplevel(const Toplevel& toplevel) -> std::optional<Value>;
 };
 
 #endif // EASYEASYLISP_HPP
@@ -1,16 +1,19 @@
-#include <fmt/core.h>
+#include <array>
+#include <charconv>
+#include <fmt/format.h>
 #include <fstream>
 #include <iostream>
 
+#include "cpp_emitter.hpp"
 #include "file_util.hpp"
 #include "interpreter.hpp"
 #include "parser.hpp"
 
 namespace {
-void repl()
+void repl(const InterpreterOptions& options)
 {
   std::string line;
-  Interpreter interpreter;
+  Interpreter interpreter{options};
 
   while (true) {
     fmt::print(">> ");
@@ -34,7 +37,42 @@ void repl()
   }
 }
 
-void run_file(const char* filename)
+// Prints the cells of a heap per size class. Objects of different types that
+// have the same size share a size class, so the types are only the ones that
+// may occupy its cells.
+void print_heap_stats(const HeapStats& stats, bool own_heap)
+{
+  constexpr std::array<std::pair<std::string_view, std::size_t>, 6> types{{
+      {"cons", sizeof(Cons)},
+      {"proc", sizeof(Proc)},
+      {"builtin", sizeof(BuiltinProc)},
+      {"sequence", sizeof(Sequence)},
+      {"integer", sizeof(BoxedInteger)},
+      {"environment", sizeof(Environment)},
+  }};
+
+  fmt::print(stderr, "{}: {} blocks, {} large objects\n",
+             own_heap ? "heap of the interpreter"
+                      : "heap shared by the interpreters of the thread",
+             stats.blocks, stats.large_objects);
+  fmt::print(stderr, "cells per size class, not per object type:\n");
+  fmt::print(stderr, "{:>10} {:>12} {:>12} {}\n", "cell size", "live", "free",
+             "types of this size");
+  for (const auto& size_class : stats.size_classes) {
+    std::vector<std::string_view> names;
+    for (const auto& [name, size] : types) {
+      if (Heap::cell_size(size) == size_class.cell_size) {
+        names.push_back(name);
+      }
+    }
+    fmt::print(stderr, "{:>10} {:>12} {:>12} {}\n", size_class.cell_size,
+               size_class.live, size_class.free,
+               names.empty() ? "-" : fmt::format("{}", fmt::join(names, ", ")));
+  }
+}
+
+void run_file(const char* filename, const InterpreterOptions& options,
+              bool heap_stats)
 {
   std::ifstream file{filename};
 
@@ -44,25 +82,116 @@ void run_file(const char* filename)
   }
 
   const auto source = file_to_string(file);
-  Interpreter interpreter;
+  Interpreter interpreter{options};
   try {
     interpreter.interpret(parse(source));
   } catch (const std::exception& e) {
     fmt::print("{}\n", e.what());
   }
+  if (heap_stats) {
+    print_heap_stats(interpreter.heap_stats(),
+                     options.memory_resource != nullptr);
+  }
+}
+
+void emit_file(const char* filename, const char* output_filename,
+               const InterpreterOptions& options)
+{
+  std::ifstream file{filename};
+  if (!file.is_open()) {
+    fmt::print(stderr, "Cannot open file {}\n", filename);
+    std::exit(1);
+  }
+
+  std::string output;
+  try {
+    auto program = parse(file_to_string(file));
+    if (options.optimization != OptimizationLevel::O0) {
+      program =
+          optimize(program, *make_ref<Environment>(Environment::create_global),
+                   options.optimization);
+    }
+    output = emit_cpp(program);
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "{}\n", e.what());
+    std::exit(1);
+  }
+
+  std::ofstream output_file{output_filename};
+  output_file << output;
+  if (!output_file) {
+    fmt::print(stderr, "Cannot write file {}\n", output_filename);
+    std::exit(1);
+  }
+}
+
+[[noreturn]] void print_usage_and_exit()
+{
+  fmt::print(stderr, "Usage: easylisp [--engine=tree|vm|closure] "
+                     "[-O0|-O1|-O2] [--max-depth=N] [--heap-stats] "
+                     "[filename]\n"
+                     "       easylisp [-O0|-O1|-O2] --emit-cpp output.cpp "
+                     "filename\n");
+  std::exit(2);
+}
+
+[[nodiscard]] auto parse_option(std::string_view arg,
+                                InterpreterOptions& options) -> bool
+{
+  if (arg == "--engine=tree") {
+    options.engine = Engine::tree_walker;
+  } else if (arg == "--engine=vm") {
+    options.engine = Engine::vm;
+  } else if (arg == "--engine=closure") {
+    options.engine = Engine::closure;
+  } else if (arg == "-O0") {
+    options.optimization = OptimizationLevel::O0;
+  } else if (arg == "-O1") {
+    options.optimization = OptimizationLevel::O1;
+  } else if (arg == "-O2") {
+    options.optimization = OptimizationLevel::O2;
+  } else if (arg.starts_with("--max-depth=")) {
+    const auto value = arg.substr(std::string_view{"--max-depth="}.size());
+    const auto [ptr, ec] = std::from_chars(
+        value.data(), value.data() + value.size(), options.max_call_depth);
+    return ec == std::errc{} && ptr == value.data() + value.size();
+  } else {
+    return false;
+  }
+  return true;
 }
 
 } // anonymous namespace
 
 auto main(int argc, const char* argv[]) -> int
 try {
-  if (argc == 1) {
-    repl();
-  } else if (argc == 2) {
-    run_file(argv[1]);
+  InterpreterOptions options;
+  const char* filename = nullptr;
+  const char* emit_cpp_filename = nullptr;
+  bool heap_stats = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--emit-cpp") {
+      if (++i == argc) { print_usage_and_exit(); }
+      emit_cpp_filename = argv[i];
+    } else if (arg == "--heap-stats") {
+      heap_stats = true;
+    } else if (arg.starts_with("-")) {
+      if (!parse_option(arg, options)) { print_usage_and_exit(); }
+    } else if (filename == nullptr) {
+      filename = argv[i];
+    } else {
+      print_usage_and_exit();
+    }
+  }
+
+  if (emit_cpp_filename != nullptr) {
+    if (filename == nullptr) { print_usage_and_exit(); }
+    emit_file(filename, emit_cpp_filename, options);
+  } else if (filename == nullptr) {
+    repl(options);
   } else {
-    fmt::print(stderr, "Usage: easylisp [filename]\n");
-    std::exit(2);
+    run_file(filename, options, heap_stats);
   }
 } catch (const std::exception& e) {
   fmt::print("Uncaught exception:\n{}\n", e.what());
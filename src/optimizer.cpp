@@ -0,0 +1,489 @@
+#include "optimizer.hpp"
+#include "environment.hpp"
+#include "file_util.hpp"
+#include "interpreter.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// The builtins without side effects, which can run ahead of time
+constexpr std::array<std::string_view, 17> pure_builtins{
+    "+", "-", "*", "/", "<", "<=", ">", ">=", "eq?", "equal?", "not", "and",
+    "or", "number?", "boolean?", "null?", "pair?"};
+
+// The builtin constants that can be folded
+constexpr std::array<std::string_view, 2> builtin_constants{"true", "false"};
+
+[[nodiscard]] auto constant_value(const Expr& expr) -> std::optional<Value>
+{
+  if (const auto* number = dynamic_cast<const NumberExpr*>(&expr)) {
+    return Value::number(number->value);
+  }
+  if (const auto* boolean = dynamic_cast<const BooleanExpr*>(&expr)) {
+    return Value{boolean->value};
+  }
+  return std::nullopt;
+}
+
+// The largest body of a global procedure that is inlined, in expressions
+constexpr std::size_t inline_budget = 16;
+// How deep inlined procedures are inlined into each other
+constexpr std::size_t max_inline_depth = 4;
+
+// Measures the body of a procedure and finds the global variables it uses
+struct BodyScanner : ExprVisitor {
+  std::size_t size = 0;
+  std::vector<Symbol> globals;
+
+  void scan(const Expr& expr)
+  {
+    ++size;
+    expr.accept(*this);
+  }
+
+  void visit(const NumberExpr&) override {}
+
+  void visit(const BooleanExpr&) override {}
+
+  void visit(const VariableExpr& expr) override
+  {
+    if (expr.address.is_global()) { globals.push_back(expr.id); }
+  }
+
+  void visit(const ApplyExpr& expr) override
+  {
+    scan(*expr.func);
+    for (const auto* arg : expr.arguments) { scan(*arg); }
+  }
+
+  void visit(const LambdaExpr& expr) override { scan(*expr.body); }
+
+  void visit(const LetExpr& expr) override
+  {
+    for (const auto& binding : expr.bindings) { scan(*binding.expr); }
+    scan(*expr.body);
+  }
+
+  void visit(const IfExpr& expr) override
+  {
+    scan(*expr.cond_expr);
+    scan(*expr.if_expr);
+    scan(*expr.else_expr);
+  }
+};
+
+// Replaces the require clauses of a program with the modules they load.
+// Modules that cannot be loaded are left to raise their error when the program
+// runs.
+void expand_requires(const Program& program, Program& result,
+                     std::vector<std::string>& modules)
+{
+  for (const auto& toplevel : program) {
+    const auto* require = std::get_if<Require>(&toplevel);
+    if (!require || std::ranges::find(modules, require->module_name) !=
+                        modules.end()) {
+      result.push_back(toplevel);
+      continue;
+    }
+
+    std::ifstream file{fmt::format("{}.easylisp", require->module_name)};
+    std::optional<Program> module;
+    try {
+      if (file.is_open()) { module = parse(file_to_string(file)); }
+    } catch (const std::runtime_error&) {
+      // The syntax error is raised when the program runs
+    }
+    if (!module) {
+      result.push_back(toplevel);
+      continue;
+    }
+
+    modules.push_back(require->module_name);
+    expand_requires(*module, result, modules);
+    modules.pop_back();
+  }
+}
+
+class Optimizer : ExprVisitor {
+  // A variable bound by an enclosing lambda or let expression
+  struct Local {
+    Symbol variable;
+    // The constant that replaces the variable, if it is bound to one
+    const Expr* constant = nullptr;
+    // The variable that replaces the variable, if it is bound to a variable
+    // of an enclosing scope, whose scope keeps it in place
+    Local* alias = nullptr;
+    bool used = false;
+  };
+
+  // A global procedure that can be inlined
+  struct Inlinable {
+    const LambdaExpr* lambda;
+    // The index of the toplevel that defines the procedure
+    std::size_t toplevel;
+    std::vector<Symbol> globals;
+  };
+
+  Ref<AstArena> arena_ = make_ref<AstArena>();
+  const Environment& global_;
+  OptimizationLevel level_;
+  // The global variables that the program defines
+  std::unordered_set<Symbol> defined_;
+  std::unordered_map<Symbol, Inlinable> inlinables_;
+  // The innermost scope is the last
+  std::vector<std::vector<Local>> scopes_;
+  // The global procedures being inlined, the innermost is the last
+  std::vector<Symbol> inlining_;
+  std::size_t toplevel_ = 0;
+  // The number of lambda expressions around the current expression, whose
+  // body may run after later toplevels redefined the globals it uses
+  std::size_t lambda_depth_ = 0;
+  // Whether a module that was not loaded ahead of time may have redefined
+  // the globals by now
+  bool after_require_ = false;
+  const Expr* result_ = nullptr;
+
+public:
+  Optimizer(const Program& program, const Environment& global,
+            OptimizationLevel level)
+      : global_{global}, level_{level}
+  {
+    std::unordered_set<Symbol> redefined;
+    for (const auto& toplevel : program) {
+      if (const auto* definition = std::get_if<Definition>(&toplevel)) {
+        if (!defined_.insert(definition->var).second) {
+          redefined.insert(definition->var);
+        }
+      }
+    }
+    if (level_ == OptimizationLevel::O2) {
+      find_inlinables(program, redefined);
+    }
+  }
+
+  [[nodiscard]] auto optimize(const Program& program) -> Program
+  {
+    Program result;
+    result.reserve(program.size());
+    for (toplevel_ = 0; toplevel_ < program.size(); ++toplevel_) {
+      const auto& toplevel = program[toplevel_];
+      if (std::holds_alternative<Require>(toplevel)) { after_require_ = true; }
+      result.push_back(std::visit(
+          overloaded{[&](const ExprPtr& expr) -> Toplevel {
+                       return arena_->share(optimize(*expr));
+                     },
+                     [&](const Definition& definition) -> Toplevel {
+                       return Definition{
+                           definition.var,
+                           arena_->share(optimize(*definition.expr))};
+                     },
+                     [](const Require& require) -> Toplevel {
+                       return require;
+                     }},
+          toplevel));
+    }
+    resolve(result);
+    return result;
+  }
+
+private:
+  // Finds the global procedures that are defined once, as a small lambda
+  // expression that does not call itself, and cannot be redefined by a module
+  // that is required later
+  void find_inlinables(const Program& program,
+                       const std::unordered_set<Symbol>& redefined)
+  {
+    for (std::size_t i = program.size(); i-- > 0;) {
+      if (std::holds_alternative<Require>(program[i])) { break; }
+      const auto* definition = std::get_if<Definition>(&program[i]);
+      if (!definition || redefined.contains(definition->var)) { continue; }
+      const auto* lambda =
+          dynamic_cast<const LambdaExpr*>(definition->expr.get());
+      if (!lambda) { continue; }
+
+      BodyScanner scanner;
+      scanner.scan(*lambda->body);
+      if (scanner.size <= inline_budget &&
+          std::ranges::find(scanner.globals, definition->var) ==
+              scanner.globals.end()) {
+        inlinables_.emplace(definition->var,
+                            Inlinable{lambda, i, MOV(scanner.globals)});
+      }
+    }
+  }
+
+  auto optimize(const Expr& expr) -> const Expr*
+  {
+    expr.accept(*this);
+    return result_;
+  }
+
+  auto find_local(Symbol id) -> Local*
+  {
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+      // When a variable appears more than once in a scope, the last one wins
+      const auto local = std::ranges::find(
+          scope->rbegin(), scope->rend(), id, &Local::variable);
+      if (local != scope->rend()) { return &*local; }
+    }
+    return nullptr;
+  }
+
+  // The value of a builtin global variable that the program does not change.
+  // Only code that runs right away can rely on it, since later toplevels and
+  // programs may redefine the builtin before a procedure body runs.
+  [[nodiscard]] auto builtin(const Expr& expr,
+                             std::span<const std::string_view> names)
+      -> const Value*
+  {
+    const auto* variable = dynamic_cast<const VariableExpr*>(&expr);
+    if (!variable || lambda_depth_ > 0 || after_require_ ||
+        find_local(variable->id) ||
+        defined_.contains(variable->id) ||
+        std::ranges::find(names, variable->id.name()) == names.end()) {
+      return nullptr;
+    }
+    return global_.find_global(variable->id);
+  }
+
+  [[nodiscard]] auto make_constant(const Value& value) -> const Expr*
+  {
+    if (value.is_integer()) {
+      return arena_->make<NumberExpr>(Number{value.as_integer()});
+    }
+    if (value.is_double()) {
+      return arena_->make<NumberExpr>(Number{value.as_double()});
+    }
+    if (value.is_boolean()) {
+      return arena_->make<BooleanExpr>(value.as_boolean());
+    }
+    return nullptr;
+  }
+
+  // Applies a builtin to constant arguments, unless it raises an error or
+  // produces something that is not a constant
+  [[nodiscard]] auto fold(const Expr& func, std::span<const Expr* const> args)
+      -> const Expr*
+  {
+    const auto* func_val = builtin(func, pure_builtins);
+    const auto* proc =
+        func_val ? object_cast<BuiltinProc>(func_val->as_object()) : nullptr;
+    // A builtin bound to the name of another builtin is not folded
+    if (!proc ||
+        proc->name != static_cast<const VariableExpr&>(func).id.name()) {
+      return nullptr;
+    }
+
+    std::vector<Value> arg_vals;
+    arg_vals.reserve(args.size());
+    for (const auto* arg : args) {
+      auto value = constant_value(*arg);
+      if (!value) { return nullptr; }
+      arg_vals.push_back(MOV(*value));
+    }
+
+    try {
+      return make_constant(apply_builtin(*proc, arg_vals));
+    } catch (const std::runtime_error&) {
+      return nullptr;
+    }
+  }
+
+  // Whether evaluating an optimized expression can neither fail nor have
+  // side effects
+  [[nodiscard]] auto is_pure(const Expr& expr) -> bool
+  {
+    if (constant_value(expr) || dynamic_cast<const LambdaExpr*>(&expr)) {
+      return true;
+    }
+    const auto* variable = dynamic_cast<const VariableExpr*>(&expr);
+    return variable && find_local(variable->id);
+  }
+
+  void visit(const NumberExpr& expr) override
+  {
+    result_ = arena_->make<NumberExpr>(expr.value);
+  }
+
+  void visit(const BooleanExpr& expr) override
+  {
+    result_ = arena_->make<BooleanExpr>(expr.value);
+  }
+
+  void visit(const VariableExpr& expr) override
+  {
+    if (auto* local = find_local(expr.id)) {
+      if (local->constant) {
+        result_ = local->constant;
+        return;
+      }
+      if (local->alias && find_local(local->alias->variable) == local->alias) {
+        local->alias->used = true;
+        result_ = arena_->make<VariableExpr>(local->alias->variable);
+        return;
+      }
+      local->used = true;
+    } else if (const auto* value = builtin(expr, builtin_constants);
+               value && value->is_boolean()) {
+      result_ = arena_->make<BooleanExpr>(value->as_boolean());
+      return;
+    }
+    result_ = arena_->make<VariableExpr>(expr.id);
+  }
+
+  void visit(const ApplyExpr& expr) override
+  {
+    if (level_ == OptimizationLevel::O2) {
+      if (const auto* lambda = dynamic_cast<const LambdaExpr*>(expr.func);
+          lambda && lambda->parameters.size() == expr.arguments.size()) {
+        result_ = inline_call(*lambda, expr.arguments);
+        return;
+      }
+      if (const auto* inlinable = find_inlinable(expr)) {
+        inlining_.push_back(static_cast<const VariableExpr&>(*expr.func).id);
+        result_ = inline_call(*inlinable->lambda, expr.arguments);
+        inlining_.pop_back();
+        return;
+      }
+    }
+
+    const auto* func = optimize(*expr.func);
+    std::pmr::vector<const Expr*> args{arena_->resource()};
+    args.reserve(expr.arguments.size());
+    for (const auto* arg : expr.arguments) { args.push_back(optimize(*arg)); }
+
+    result_ = fold(*func, args);
+    if (!result_) { result_ = arena_->make<ApplyExpr>(func, MOV(args)); }
+  }
+
+  void visit(const LambdaExpr& expr) override
+  {
+    std::vector<Local> parameters;
+    parameters.reserve(expr.parameters.size());
+    for (const auto parameter : expr.parameters) {
+      parameters.push_back(Local{parameter});
+    }
+
+    scopes_.push_back(MOV(parameters));
+    ++lambda_depth_;
+    const auto* body = optimize(*expr.body);
+    --lambda_depth_;
+    scopes_.pop_back();
+    result_ = arena_->make<LambdaExpr>(
+        std::pmr::vector<Symbol>{expr.parameters, arena_->resource()}, body,
+        *arena_);
+  }
+
+  // The global procedure that an application can inline, if any. A procedure
+  // body may run after a later program redefined the procedure, so only code
+  // that runs right away inlines global procedures.
+  [[nodiscard]] auto find_inlinable(const ApplyExpr& expr) -> const Inlinable*
+  {
+    const auto* variable = dynamic_cast<const VariableExpr*>(expr.func);
+    if (!variable || lambda_depth_ > 0 || find_local(variable->id) ||
+        inlining_.size() == max_inline_depth ||
+        std::ranges::find(inlining_, variable->id) != inlining_.end()) {
+      return nullptr;
+    }
+
+    const auto itr = inlinables_.find(variable->id);
+    if (itr == inlinables_.end()) { return nullptr; }
+    const auto& inlinable = itr->second;
+    // Earlier toplevels may run before the procedure is defined, and the
+    // variables of the procedure must not be shadowed at the call site
+    if (inlinable.toplevel >= toplevel_ ||
+        inlinable.lambda->parameters.size() != expr.arguments.size() ||
+        std::ranges::any_of(inlinable.globals,
+                            [&](Symbol id) { return find_local(id); })) {
+      return nullptr;
+    }
+    return &inlinable;
+  }
+
+  // Binds the arguments of an application to the parameters of lambda in a
+  // let expression around its body
+  [[nodiscard]] auto inline_call(const LambdaExpr& lambda,
+                                 std::span<const Expr* const> args)
+      -> const Expr*
+  {
+    std::vector<Binding> bindings;
+    bindings.reserve(args.size());
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      bindings.push_back(Binding{lambda.parameters[i], args[i]});
+    }
+    return optimize_let(bindings, *lambda.body);
+  }
+
+  void visit(const LetExpr& expr) override
+  {
+    result_ = optimize_let(expr.bindings, *expr.body);
+  }
+
+  auto optimize_let(std::span<const Binding> let_bindings, const Expr& let_body)
+      -> const Expr*
+  {
+    std::vector<const Expr*> values;
+    std::vector<Local> variables;
+    values.reserve(let_bindings.size());
+    variables.reserve(let_bindings.size());
+    for (const auto& binding : let_bindings) {
+      const auto* value = optimize(*binding.expr);
+      const auto* variable = dynamic_cast<const VariableExpr*>(value);
+      values.push_back(value);
+      variables.push_back(Local{binding.variable,
+                                constant_value(*value) ? value : nullptr,
+                                variable ? find_local(variable->id) : nullptr});
+    }
+
+    scopes_.push_back(MOV(variables));
+    const auto* body = optimize(let_body);
+    variables = MOV(scopes_.back());
+    scopes_.pop_back();
+
+    std::pmr::vector<Binding> bindings{arena_->resource()};
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      if (variables[i].used || !is_pure(*values[i])) {
+        bindings.push_back(Binding{variables[i].variable, values[i]});
+      }
+    }
+    return bindings.empty() ? body
+                            : arena_->make<LetExpr>(MOV(bindings), body);
+  }
+
+  void visit(const IfExpr& expr) override
+  {
+    const auto* cond = optimize(*expr.cond_expr);
+    if (const auto* boolean = dynamic_cast<const BooleanExpr*>(cond)) {
+      result_ = optimize(boolean->value ? *expr.if_expr : *expr.else_expr);
+      return;
+    }
+    const auto* if_expr = optimize(*expr.if_expr);
+    const auto* else_expr = optimize(*expr.else_expr);
+    result_ = arena_->make<IfExpr>(cond, if_expr, else_expr);
+  }
+};
+
+} // anonymous namespace
+
+auto optimize(const Program& program, const Environment& global,
+              OptimizationLevel level) -> Program
+{
+  if (level == OptimizationLevel::O0) { return program; }
+  if (level == OptimizationLevel::O1) {
+    return Optimizer{program, global, level}.optimize(program);
+  }
+
+  Program expanded;
+  std::vector<std::string> modules;
+  expand_requires(program, expanded, modules);
+  return Optimizer{expanded, global, level}.optimize(expanded);
+}
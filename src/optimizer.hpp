@@ -0,0 +1,42 @@
+#ifndef EASYLISP_OPTIMIZER_HPP
+#define EASYLISP_OPTIMIZER_HPP
+
+#include "ast.hpp"
+
+/// @brief How much a program is optimized before it runs
+enum class OptimizationLevel {
+  O0, ///< Runs the program as it is parsed
+  O1, ///< Folds constants and simplifies let and if expressions
+  O2, ///< Also inlines small procedures
+};
+
+/**
+ * @brief Optimizes a program ahead of time
+ *
+ * From O1 on, applications of side-effect free builtins to constant arguments
+ * are evaluated, if expressions with a constant condition are replaced by the
+ * branch they take, let bindings of constants and local variables are
+ * substituted into the body, and let bindings that are never used and cannot
+ * fail are removed.
+ *
+ * A builtin is folded only while global still binds its name to the builtin
+ * and the program does not define the name, and only outside of lambda
+ * expressions and before the first require that is not loaded ahead of time:
+ * a procedure body may run after later toplevels redefined the builtin.
+ * Applications that raise an error are left in place to raise it when they
+ * run.
+ *
+ * From O2 on, applications of lambda expressions and of small global
+ * procedures become let expressions around the body of the procedure. A
+ * global procedure is inlined only when the program defines it once, as a
+ * lambda expression that does not call itself, and only into the toplevels
+ * that follow its definition, outside of lambda expressions. Required
+ * modules are loaded ahead of time to inline their procedures too, which also
+ * makes sure that they do not redefine inlined procedures.
+ *
+ * The optimized program lives in an arena of its own and is resolved again.
+ */
+[[nodiscard]] auto optimize(const Program& program, const Environment& global,
+                            OptimizationLevel level) -> Program;
+
+#endif // EASYLISP_OPTIMIZER_HPP
@@ -1,4 +1,5 @@
 #include "parser.hpp"
+#include "resolver.hpp"
 #include "scanner.hpp"
 
 #include <algorithm>
@@ -10,6 +11,7 @@ namespace {
 
 class Parser {
   Scanner itr_;
+  Ref<AstArena> arena_ = make_ref<AstArena>();
 
 public:
   explicit Parser(std::string_view source) : itr_{source} {}
@@ -36,7 +38,7 @@ public:
       }
     }
 
-    return parse_expr();
+    return arena_->share(parse_expr());
   }
 
 private:
@@ -58,19 +60,20 @@ private:
   auto parse_definition() -> Definition
   {
     auto binding = parse_binding();
-    return Definition{MOV(binding.variable), MOV(binding.expr)};
+    return Definition{MOV(binding.variable), arena_->share(binding.expr)};
   }
 
-  auto parse_expr() -> ExprPtr
+  auto parse_expr() -> const Expr*
   {
     switch (itr_->type) {
     case TokenType::number: {
-      auto expr = std::make_shared<NumberExpr>(itr_->data.number);
+      const auto* expr = arena_->make<NumberExpr>(itr_->data.number);
       ++itr_;
       return expr;
     }
     case TokenType::identifier: {
-      auto expr = std::make_shared<VariableExpr>(std::string{itr_->lexeme});
+      const auto* expr =
+          arena_->make<VariableExpr>(itr_->data.symbol);
       ++itr_;
       return expr;
     }
@@ -88,7 +91,7 @@ private:
     }
   }
 
-  auto parse_parenthesis() -> ExprPtr
+  auto parse_parenthesis() -> const Expr*
   {
     switch (itr_->type) {
     case TokenType::keyword_lambda:
@@ -105,37 +108,36 @@ private:
     }
   }
 
-  auto parse_if() -> ExprPtr
+  auto parse_if() -> const Expr*
   {
-    auto cond_expr = parse_expr();
-    auto if_expr = parse_expr();
-    auto else_expr = parse_expr();
+    const auto* cond_expr = parse_expr();
+    const auto* if_expr = parse_expr();
+    const auto* else_expr = parse_expr();
     consume_right_param();
-    return std::make_shared<IfExpr>(MOV(cond_expr), MOV(if_expr),
-                                    MOV(else_expr));
+    return arena_->make<IfExpr>(cond_expr, if_expr, else_expr);
   }
 
-  auto parse_apply() -> ExprPtr
+  auto parse_apply() -> const Expr*
   {
-    auto func = parse_expr();
-    std::vector<ExprPtr> args;
+    const auto* func = parse_expr();
+    std::pmr::vector<const Expr*> args{arena_->resource()};
     while (!is_at_end() && itr_->type != TokenType::right_paren) {
       args.push_back(parse_expr());
     }
 
     consume_right_param();
 
-    return std::make_shared<ApplyExpr>(MOV(func), MOV(args));
+    return arena_->make<ApplyExpr>(func, MOV(args));
   }
 
-  auto parse_lambda() -> ExprPtr
+  auto parse_lambda() -> const Expr*
   {
-    std::vector<std::string> parameters;
+    std::pmr::vector<Symbol> parameters{arena_->resource()};
     consume_one(TokenType::left_paren, "Syntax error: expect parameter list");
 
     while (!is_at_end() && itr_->type != TokenType::right_paren) {
       if (match(TokenType::identifier)) {
-        parameters.emplace_back(itr_->lexeme);
+        parameters.push_back(itr_->data.symbol);
         ++itr_;
       } else {
         throw std::runtime_error(
@@ -144,14 +146,14 @@ private:
     }
     consume_right_param();
 
-    auto body = parse_expr();
+    const auto* body = parse_expr();
     consume_right_param();
-    return std::make_shared<LambdaExpr>(parameters, MOV(body));
+    return arena_->make<LambdaExpr>(MOV(parameters), body, *arena_);
   }
 
-  auto parse_let() -> ExprPtr
+  auto parse_let() -> const Expr*
   {
-    std::vector<Binding> bindings;
+    std::pmr::vector<Binding> bindings{arena_->resource()};
     consume_one(TokenType::left_paren, "Syntax error: expect variable list");
 
     while (!is_at_end() && itr_->type != TokenType::right_paren) {
@@ -160,9 +162,9 @@ private:
     }
     consume_right_param();
 
-    auto body = parse_expr();
+    const auto* body = parse_expr();
     consume_right_param();
-    return std::make_shared<LetExpr>(MOV(bindings), MOV(body));
+    return arena_->make<LetExpr>(MOV(bindings), body);
   }
 
   auto parse_binding() -> Binding
@@ -170,11 +172,11 @@ private:
     if (itr_->type != TokenType::identifier) {
       throw std::runtime_error("Syntax error: expect variable name");
     }
-    std::string variable{itr_->lexeme};
+    const Symbol variable = itr_->data.symbol;
     ++itr_;
-    ExprPtr expr = parse_expr();
+    const auto* expr = parse_expr();
     consume_right_param();
-    return Binding{variable, MOV(expr)};
+    return Binding{variable, expr};
   }
 
   void consume_one(TokenType token_type, const char* error_message)
@@ -196,5 +198,6 @@ private:
   Parser parser{source};
   Program program;
   while (!parser.is_at_end()) { program.push_back(parser.parse_toplevel()); }
+  resolve(program);
   return program;
 }
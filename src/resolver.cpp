@@ -0,0 +1,124 @@
+#include "resolver.hpp"
+
+#include <algorithm>
+
+namespace {
+
+struct Resolver : ExprVisitor {
+  // A lambda expression being resolved, or the toplevel expression
+  struct Function {
+    const LambdaExpr* lambda;
+    // The index of the outermost scope of the function
+    std::size_t first_scope;
+  };
+
+  // The variables of every enclosing scope, the innermost scope is the last
+  std::vector<std::vector<Symbol>> scopes;
+  // Every enclosing function, the innermost function is the last
+  std::vector<Function> functions{Function{nullptr, 0}};
+
+  void resolve_expr(const Expr& expr) { expr.accept(*this); }
+
+  void resolve_in_scope(const Expr& expr, std::vector<Symbol> variables)
+  {
+    scopes.push_back(MOV(variables));
+    resolve_expr(expr);
+    scopes.pop_back();
+  }
+
+  // Finds a variable from where the function at index function is currently
+  // being resolved, capturing it in every function it is free in
+  auto lookup(Symbol id, std::size_t function) -> LexicalAddress
+  {
+    const auto first_scope = functions[function].first_scope;
+    const auto scope_end = function + 1 < functions.size()
+                               ? functions[function + 1].first_scope
+                               : scopes.size();
+    for (std::size_t depth = 0; depth < scope_end - first_scope; ++depth) {
+      const auto& scope = scopes[scope_end - depth - 1];
+      // When a variable appears more than once in a scope, the last one wins
+      for (std::size_t slot = scope.size(); slot-- > 0;) {
+        if (scope[slot] == id) {
+          return LexicalAddress{static_cast<std::uint32_t>(depth),
+                                static_cast<std::uint32_t>(slot)};
+        }
+      }
+    }
+
+    const auto* lambda = functions[function].lambda;
+    if (lambda == nullptr) { return LexicalAddress{}; }
+    auto& captures = lambda->captures;
+    auto itr = std::ranges::find(captures, id, &Capture::variable);
+    if (itr == captures.end()) {
+      const auto address = lookup(id, function - 1);
+      if (address.is_global()) { return address; }
+      captures.push_back(Capture{id, address});
+      itr = captures.end() - 1;
+    }
+    // The captured frame is right outside of the scopes of the function
+    return LexicalAddress{
+        static_cast<std::uint32_t>(scope_end - first_scope),
+        static_cast<std::uint32_t>(itr - captures.begin())};
+  }
+
+  void visit(const NumberExpr&) override {}
+
+  void visit(const BooleanExpr&) override {}
+
+  void visit(const VariableExpr& expr) override
+  {
+    expr.address = lookup(expr.id, functions.size() - 1);
+  }
+
+  void visit(const ApplyExpr& expr) override
+  {
+    resolve_expr(*expr.func);
+    for (const auto& arg : expr.arguments) { resolve_expr(*arg); }
+  }
+
+  void visit(const LambdaExpr& expr) override
+  {
+    expr.captures.clear();
+    functions.push_back(Function{&expr, scopes.size()});
+    resolve_in_scope(*expr.body, {expr.parameters.begin(),
+                                  expr.parameters.end()});
+    functions.pop_back();
+  }
+
+  void visit(const LetExpr& expr) override
+  {
+    std::vector<Symbol> variables;
+    variables.reserve(expr.bindings.size());
+    for (const auto& binding : expr.bindings) {
+      resolve_expr(*binding.expr);
+      variables.push_back(binding.variable);
+    }
+    resolve_in_scope(*expr.body, MOV(variables));
+  }
+
+  void visit(const IfExpr& expr) override
+  {
+    resolve_expr(*expr.cond_expr);
+    resolve_expr(*expr.if_expr);
+    resolve_expr(*expr.else_expr);
+  }
+};
+
+} // anonymous namespace
+
+void resolve(const Expr& expr)
+{
+  Resolver{}.resolve_expr(expr);
+}
+
+void resolve(const Program& program)
+{
+  for (const auto& toplevel : program) {
+    std::visit(overloaded{[](const ExprPtr& expr) { resolve(*expr); },
+                          [](const Definition& definition) {
+                            resolve(*definition.expr);
+                          },
+                          [](const Require&) {}},
+               toplevel);
+  }
+}
@@ -0,0 +1,17 @@
+#ifndef EASYLISP_RESOLVER_HPP
+#define EASYLISP_RESOLVER_HPP
+
+#include "ast.hpp"
+
+/**
+ * @brief Annotates every variable expression in the program with its lexical
+ * address
+ *
+ * Variables bound by lambda and let expressions get the frame depth and slot
+ * index of their binding. The other variables are left as globals. Lambda
+ * expressions also get the free variables that their closures capture.
+ */
+void resolve(const Program& program);
+void resolve(const Expr& expr);
+
+#endif // EASYLISP_RESOLVER_HPP
@@ -3,6 +3,7 @@
 #include <fast_float/fast_float.h>
 
 #include <algorithm>
+#include <charconv>
 
 namespace {
 [[nodiscard]] auto is_space(char c) -> bool
@@ -38,12 +39,17 @@ void Scanner::advance()
     return;
   }
 
-  Number number = 0;
+  double number = 0;
   if (auto [p, ec] = fast_float::from_chars(begin_, end_, number);
       ec == std::errc()) {
+    // Literals that are only digits are integers, unless they overflow
+    std::int64_t integer = 0;
+    const auto [integer_end, integer_ec] = std::from_chars(begin_, p, integer);
+    const bool is_integer = integer_ec == std::errc() && integer_end == p;
     current_token_ = Token{.type = TokenType::number,
                            .lexeme = {begin_, p},
-                           .data{.number = number}};
+                           .data{.number = is_integer ? Number{integer}
+                                                      : Number{number}}};
     begin_ = p;
     return;
   }
@@ -91,8 +97,12 @@ auto Scanner::check_keyword(unsigned int start_offset, std::string_view rest,
 void Scanner::find_identifier()
 {
   const char* ident_end = std::find_if(begin_, end_, not_valid_identifier_char);
-  current_token_ = Token{.type = identifier_type(),
-                         .lexeme = std::string_view{begin_, ident_end}};
+  const std::string_view lexeme{begin_, ident_end};
+  const TokenType type = identifier_type();
+  current_token_ = Token{.type = type, .lexeme = lexeme};
+  if (type == TokenType::identifier) {
+    current_token_.data.symbol = Symbol{lexeme};
+  }
   begin_ = ident_end;
 }
 
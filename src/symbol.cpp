@@ -0,0 +1,57 @@
+#include "symbol.hpp"
+
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// Shared by every thread, so that a symbol means the same name everywhere
+class SymbolTable {
+  // A deque never moves its elements, so the views into it stay valid
+  std::deque<std::string> names_{""};
+  std::unordered_map<std::string_view, std::uint32_t> ids_{{names_[0], 0}};
+  mutable std::shared_mutex mutex_;
+
+public:
+  [[nodiscard]] auto intern(std::string_view name) -> std::uint32_t
+  {
+    {
+      const std::shared_lock lock{mutex_};
+      if (const auto itr = ids_.find(name); itr != ids_.end()) {
+        return itr->second;
+      }
+    }
+    const std::unique_lock lock{mutex_};
+    // Another thread may have interned the name in the meantime
+    if (const auto itr = ids_.find(name); itr != ids_.end()) {
+      return itr->second;
+    }
+    const auto id = static_cast<std::uint32_t>(names_.size());
+    ids_.emplace(names_.emplace_back(name), id);
+    return id;
+  }
+
+  [[nodiscard]] auto name(std::uint32_t id) const -> std::string_view
+  {
+    const std::shared_lock lock{mutex_};
+    return names_[id];
+  }
+};
+
+[[nodiscard]] auto symbol_table() -> SymbolTable&
+{
+  static SymbolTable table;
+  return table;
+}
+
+} // anonymous namespace
+
+Symbol::Symbol(std::string_view name) : id_{symbol_table().intern(name)} {}
+
+auto Symbol::name() const -> std::string_view
+{
+  return symbol_table().name(id_);
+}
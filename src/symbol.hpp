@@ -0,0 +1,50 @@
+#ifndef EASYLISP_SYMBOL_HPP
+#define EASYLISP_SYMBOL_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+#include <fmt/format.h>
+
+/**
+ * @brief An interned identifier
+ *
+ * Every distinct name is stored once in a global symbol table, and symbols
+ * with the same name share an id, so comparing and hashing symbols are
+ * integer operations. The table is shared by all threads and never shrinks:
+ * names stay interned until the program exits.
+ */
+class Symbol {
+  std::uint32_t id_ = 0;
+
+public:
+  /// @brief The empty symbol
+  Symbol() = default;
+  /// @brief Interns name
+  explicit Symbol(std::string_view name);
+
+  [[nodiscard]] auto id() const noexcept -> std::uint32_t { return id_; }
+  [[nodiscard]] auto name() const -> std::string_view;
+
+  [[nodiscard]] friend auto operator==(Symbol lhs, Symbol rhs) noexcept
+      -> bool = default;
+};
+
+template <> struct std::hash<Symbol> {
+  [[nodiscard]] auto operator()(Symbol symbol) const noexcept -> std::size_t
+  {
+    return symbol.id();
+  }
+};
+
+template <>
+struct fmt::formatter<Symbol> : fmt::formatter<std::string_view> {
+  template <typename FormatContext>
+  auto format(Symbol symbol, FormatContext& ctx) const
+  {
+    return fmt::formatter<std::string_view>::format(symbol.name(), ctx);
+  }
+};
+
+#endif // EASYLISP_SYMBOL_HPP
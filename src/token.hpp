@@ -3,6 +3,9 @@
 
 #include <cstdint>
 #include <string_view>
+#include <variant>
+
+#include "symbol.hpp"
 
 /// @brief The type of a token
 enum class TokenType {
@@ -18,8 +21,9 @@ enum class TokenType {
   keyword_require,
 };
 
-/// @brief A type alias that defines the number type for our language
-using Number = double;
+/// @brief A type alias that defines the number type for our language, which is
+/// an integer unless the literal has a fraction or an exponent
+using Number = std::variant<std::int64_t, double>;
 
 /**
  * @brief A token holds information about a slice of source code
@@ -28,7 +32,9 @@ struct Token {
   TokenType type = TokenType::eof;
   std::string_view lexeme = {};
   union Data {
-    Number number = 0;
+    Number number = std::int64_t{0};
+    // The interned lexeme of an identifier
+    Symbol symbol;
   } data = {};
 };
 
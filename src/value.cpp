@@ -1,107 +1,191 @@
 #include "value.hpp"
 
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
 #include <fmt/format.h>
 
-template <> struct fmt::formatter<Value> {
-  constexpr auto parse(format_parse_context& ctx) { return ctx.end(); }
+namespace {
 
-  template <typename FormatContext>
-  auto format(const Value& v, FormatContext& ctx)
-  {
-    return format_to(ctx.out(), "{}", to_string(v));
-  }
-};
+using Buffer = fmt::memory_buffer;
 
-struct ValuePrinter {
-  auto operator()(bool b) -> std::string { return fmt::format("{}", b); }
+void print_value(Buffer& out, const Value& value);
 
-  auto operator()(double number) -> std::string
-  {
-    return fmt::format("{}", number);
+// Prints the elements of a list in a loop, straight into out
+void print_cons(Buffer& out, const Cons& cons)
+{
+  out.push_back('(');
+  print_value(out, cons.car);
+  if (!cons.is_list_) {
+    fmt::format_to(std::back_inserter(out), " . ");
+    print_value(out, cons.cdr);
+  } else {
+    const Cons* ptr = &cons;
+    while ((ptr = object_cast<Cons>(ptr->cdr.as_object())) != nullptr) {
+      out.push_back(' ');
+      print_value(out, ptr->car);
+    }
   }
+  out.push_back(')');
+}
 
-  auto operator()(const ObjectPtr& obj) -> std::string
-  {
-    if (obj == nullptr) { return "()"; }
+void print_value(Buffer& out, const Value& value)
+{
+  auto itr = std::back_inserter(out);
+  if (value.is_double()) {
+    fmt::format_to(itr, "{}", value.as_double());
+    return;
+  }
+  if (value.is_fixnum()) {
+    fmt::format_to(itr, "{}", value.as_fixnum());
+    return;
+  }
+  if (value.is_boolean()) {
+    fmt::format_to(itr, "{}", value.as_boolean());
+    return;
+  }
 
-    struct ObjectPrinter : ObjectVisitor {
-      std::string result;
+  const auto* obj = value.as_object();
+  if (obj == nullptr) {
+    fmt::format_to(itr, "()");
+    return;
+  }
+  switch (obj->type()) {
+  case ObjectType::builtin_proc:
+    fmt::format_to(itr, "<builtin proc {}>",
+                   static_cast<const BuiltinProc&>(*obj).name);
+    return;
+  case ObjectType::proc:
+    fmt::format_to(itr, "<proc ({})>",
+                   fmt::join(static_cast<const Proc&>(*obj).parameters, " "));
+    return;
+  case ObjectType::cons:
+    print_cons(out, static_cast<const Cons&>(*obj));
+    return;
+  case ObjectType::sequence:
+    // Printing the elements would run the procedurals of the sequence
+    fmt::format_to(itr, "<sequence>");
+    return;
+  case ObjectType::boxed_integer:
+    fmt::format_to(itr, "{}", static_cast<const BoxedInteger&>(*obj).value);
+    return;
+  }
+}
 
-      void visit(const BuiltinProc& proc) override
-      {
-        result = fmt::format("<builtin proc {}>", proc.name);
-      }
+} // anonymous namespace
 
-      void visit(const Proc& proc) override
-      {
-        result = fmt::format("<proc ({})>", fmt::join(proc.parameters, " "));
-      }
+Cons::~Cons()
+{
+  // Every cons that only the one before it refers to is freed after its cdr
+  // has been moved out, so it never frees its own tail
+  Value tail = MOV(cdr);
+  while (tail.is_unique()) {
+    auto* next = const_cast<Cons*>(object_cast<Cons>(tail.as_object()));
+    if (next == nullptr) { break; }
+    tail = Value{MOV(next->cdr)};
+  }
+}
 
-      void visit(const Cons& cons) override
-      {
-        if (!cons.is_list_) {
-          result = fmt::format("({} . {})", cons.car, cons.cdr);
-          return;
-        }
+Sequence::~Sequence()
+{
+  // Frees the sequences that only this one consumes one after another, like
+  // the tail of a cons
+  Value tail = MOV(source);
+  while (tail.is_unique()) {
+    auto* next =
+        const_cast<Sequence*>(object_cast<Sequence>(tail.as_object()));
+    if (next == nullptr) { break; }
+    tail = Value{MOV(next->source)};
+  }
+}
 
-        std::vector<std::string> elems;
-        const Cons* ptr = &cons;
-        while (ptr != nullptr) {
-          elems.push_back(fmt::format("{}", ptr->car));
-          ptr = dynamic_cast<const Cons*>(std::get<ObjectPtr>(ptr->cdr).get());
-        }
+auto to_string(const Value& value) -> std::string
+{
+  Buffer out;
+  print_value(out, value);
+  return fmt::to_string(out);
+}
 
-        result = fmt::format("({})", fmt::join(elems, " "));
-      }
+auto is_number(const Value& value) -> bool { return value.is_number(); }
 
-    } visitor;
+auto is_boolean(const Value& value) -> bool { return value.is_boolean(); }
 
-    obj->accept(visitor);
-    return visitor.result;
-  }
-};
+auto is_null(const Value& value) -> bool { return value.is_null(); }
 
-auto to_string(const Value& value) -> std::string
+auto is_pair(const Value& value) -> bool
 {
-  return std::visit(ValuePrinter{}, value);
+  const auto* obj = value.as_object();
+  return obj && obj->is_pair();
 }
 
-auto is_number(const Value& value) -> bool
+auto is_list(const Value& value) -> bool
 {
-  return std::holds_alternative<double>(value);
+  const auto* obj = value.as_object();
+  return value.is_null() || (obj && obj->is_list());
 }
 
-auto is_boolean(const Value& value) -> bool
+auto is_procedural(const Value& value) -> bool
 {
-  return std::holds_alternative<bool>(value);
+  const auto* obj = value.as_object();
+  return obj && obj->is_procedural();
 }
 
-[[nodiscard]] static auto as_object(const Value& value) -> const ObjectPtr*
+auto Value::box(std::int64_t integer) -> Value
 {
-  return std::get_if<ObjectPtr>(&value);
+  return Value::make<BoxedInteger>(integer);
 }
 
-auto is_null(const Value& value) -> bool
+namespace {
+
+// 2^63, the first double beyond the range of std::int64_t
+constexpr auto limit = 9223372036854775808.0;
+
+// Orders an integer against a double without rounding the integer
+[[nodiscard]] auto compare_integer_double(std::int64_t lhs, double rhs) noexcept
+    -> std::partial_ordering
 {
-  const auto* obj_pptr = as_object(value);
-  return obj_pptr && (*obj_pptr == nullptr);
+  if (std::isnan(rhs)) { return std::partial_ordering::unordered; }
+  if (rhs >= limit) { return std::partial_ordering::less; }
+  if (rhs < -limit) { return std::partial_ordering::greater; }
+  // Exact, since rhs is now in the range of std::int64_t
+  const auto whole = std::trunc(rhs);
+  const auto truncated = static_cast<std::int64_t>(whole);
+  if (lhs != truncated) { return lhs <=> truncated; }
+  return 0.0 <=> rhs - whole;
 }
 
-auto is_pair(const Value& value) -> bool
+} // anonymous namespace
+
+auto Value::compare_numbers(const Value& lhs, const Value& rhs) noexcept
+    -> std::partial_ordering
 {
-  const auto* obj_pptr = as_object(value);
-  return obj_pptr && *obj_pptr && (*obj_pptr)->is_pair();
+  if (lhs.is_integer() && rhs.is_integer()) {
+    return lhs.as_integer() <=> rhs.as_integer();
+  }
+  if (lhs.is_integer()) {
+    return compare_integer_double(lhs.as_integer(), rhs.as_double());
+  }
+  if (rhs.is_integer()) {
+    return 0 <=> compare_integer_double(rhs.as_integer(), lhs.as_double());
+  }
+  return lhs.as_double() <=> rhs.as_double();
 }
 
-auto is_list(const Value& value) -> bool
+auto to_integer(const Value& number) -> std::int64_t
 {
-  const auto* obj_pptr = as_object(value);
-  return obj_pptr && (!(*obj_pptr) || ((*obj_pptr)->is_list()));
+  if (number.is_integer()) { return number.as_integer(); }
+  const auto value = number.as_double();
+  if (std::isnan(value)) {
+    throw std::runtime_error{
+        fmt::format("Type error: {} is not an integer", to_string(number))};
+  }
+  if (value >= limit) { return std::numeric_limits<std::int64_t>::max(); }
+  if (value < -limit) { return std::numeric_limits<std::int64_t>::min(); }
+  return static_cast<std::int64_t>(value);
 }
 
-auto is_procedural(const Value& value) -> bool
+auto is_sequence(const Value& value) -> bool
 {
-  const auto* obj_pptr = as_object(value);
-  if (obj_pptr && *obj_pptr) { return (*obj_pptr)->is_procedural(); }
-  return false;
-}
\ No newline at end of file
+  return object_cast<Sequence>(value.as_object()) != nullptr;
+}
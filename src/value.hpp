@@ -2,6 +2,10 @@
 #define EASYLISP_VALUE_HPP
 
 #include "ast.hpp"
+#include "heap.hpp"
+#include <bit>
+#include <compare>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <span>
@@ -13,108 +17,523 @@
 #include <fmt/format.h>
 
 class Environment;
-using EnvPtr = std::shared_ptr<const Environment>;
+using EnvPtr = Ref<const Environment>;
 
 struct BuiltinProc;
 struct Proc;
 struct Cons;
+struct Sequence;
+struct BoxedInteger;
+struct Chunk;
+struct CompiledCode;
+struct TailCall;
 
-struct ObjectVisitor {
-  ObjectVisitor() = default;
-  virtual ~ObjectVisitor() = default;
-  ObjectVisitor(const ObjectVisitor&) = delete;
-  auto operator=(const ObjectVisitor&) & -> ObjectVisitor& = delete;
-  ObjectVisitor(ObjectVisitor&&) noexcept = default;
-  auto operator=(ObjectVisitor&&) & noexcept -> ObjectVisitor& = default;
-
-  virtual void visit(const BuiltinProc&) = 0;
-  virtual void visit(const Proc&) = 0;
-  virtual void visit(const Cons&) = 0;
+/// @brief The type of an object, which identifies it without RTTI
+enum class ObjectType : std::uint8_t {
+  builtin_proc,
+  proc,
+  cons,
+  sequence,
+  boxed_integer,
 };
 
-struct Object {
-  Object() = default;
-  virtual ~Object() = default;
-  Object(const Object&) = delete;
-  auto operator=(const Object&) & -> Object& = delete;
-  Object(Object&&) noexcept = default;
-  auto operator=(Object&&) & noexcept -> Object& = default;
-
-  virtual void accept(ObjectVisitor& visitor) const = 0;
-  [[nodiscard]] virtual auto is_pair() const -> bool { return false; }
-  [[nodiscard]] virtual auto is_list() const -> bool { return false; }
-  [[nodiscard]] virtual auto is_procedural() const -> bool { return false; }
+/// @brief Builtins that the evaluators run inline instead of calling them
+enum class Intrinsic : std::uint8_t {
+  none,
+  add,
+  subtract,
+  multiply,
+  divide,
+  less,
+  less_equal,
+  greater,
+  greater_equal,
+  eq,
+  cons,
+  car,
+  cdr,
+  is_null,
+  // Higher-order builtins, which compiled closures run as loops when they are
+  // applied to a lambda expression
+  map,
+  filter,
+  foldl,
+  foldr,
+  // The source of the lists that compiled closures fuse into a single loop
+  range,
 };
-using ObjectPtr = std::shared_ptr<Object>;
+
+/**
+ * @brief The base of the values that live on the heap
+ *
+ * Every object carries its type, so that code that walks lists or applies
+ * procedurals identifies objects with a comparison or a switch, and casts
+ * them with object_cast.
+ */
+struct Object : HeapObject {
+  explicit Object(ObjectType type) noexcept : type_{type} {}
+
+  [[nodiscard]] auto type() const noexcept -> ObjectType { return type_; }
+
+  [[nodiscard]] auto intrinsic() const noexcept -> Intrinsic;
+  [[nodiscard]] auto is_pair() const noexcept -> bool
+  {
+    return type_ == ObjectType::cons;
+  }
+  [[nodiscard]] auto is_list() const noexcept -> bool;
+  [[nodiscard]] auto is_procedural() const noexcept -> bool
+  {
+    return type_ == ObjectType::builtin_proc || type_ == ObjectType::proc;
+  }
+  [[nodiscard]] auto is_integer() const noexcept -> bool
+  {
+    return type_ == ObjectType::boxed_integer;
+  }
+
+private:
+  ObjectType type_;
+};
+
+/**
+ * @brief Casts obj to the object type T if it is one, or returns null
+ */
+template <typename T>
+[[nodiscard]] auto object_cast(const Object* obj) noexcept -> const T*
+{
+  return obj && obj->type() == T::object_type ? static_cast<const T*>(obj)
+                                              : nullptr;
+}
 
 /**
  * @brief A polymorphic value type for our language
+ *
+ * A value is NaN-boxed into 64 bits. Floating-point numbers are stored as
+ * plain doubles, and the other values hide in the payload of quiet NaNs that
+ * no arithmetic produces: null and the booleans use small tags, integers that
+ * fit into 48 bits use a tag of their own, and objects use the low 48 bits for
+ * their address. Larger integers are boxed on the heap. Objects are reference
+ * counted by the values that refer to them.
  */
-using Value = std::variant<double, bool, ObjectPtr>;
+class Value {
+  static constexpr std::uint64_t sign_bit = 0x8000'0000'0000'0000;
+  static constexpr std::uint64_t quiet_nan = 0x7ffc'0000'0000'0000;
+  static constexpr std::uint64_t canonical_nan = 0x7ff8'0000'0000'0000;
+  static constexpr std::uint64_t null_bits = quiet_nan | 1;
+  static constexpr std::uint64_t false_bits = quiet_nan | 2;
+  static constexpr std::uint64_t true_bits = quiet_nan | 3;
+  static constexpr std::uint64_t object_tag = sign_bit | quiet_nan;
+  static constexpr std::uint64_t fixnum_tag = quiet_nan | 0x2'0000'0000'0000;
+  static constexpr std::uint64_t payload_mask = 0xffff'ffff'ffff;
+
+  std::uint64_t bits_ = null_bits;
+
+  explicit Value(const Object* object) noexcept
+      : bits_{object_tag | reinterpret_cast<std::uintptr_t>(object)}
+  {
+    HeapObject::retain(object);
+  }
+
+public:
+  Value() noexcept = default;
+  Value(std::nullptr_t) noexcept {}
+  Value(bool boolean) noexcept : bits_{boolean ? true_bits : false_bits} {}
+  Value(double number) noexcept
+      : bits_{number != number ? canonical_nan
+                               : std::bit_cast<std::uint64_t>(number)}
+  {}
+  // Prevents pointers from silently converting to booleans
+  template <typename T> Value(T*) = delete;
+
+  static constexpr std::int64_t fixnum_min = -(std::int64_t{1} << 47);
+  static constexpr std::int64_t fixnum_max = (std::int64_t{1} << 47) - 1;
+
+  /**
+   * @brief Creates an integer, which is boxed when it does not fit into 48 bits
+   */
+  [[nodiscard]] static auto integer(std::int64_t integer) -> Value;
+
+  /// @brief Creates the value of a number literal
+  [[nodiscard]] static auto number(const Number& number) -> Value
+  {
+    if (const auto* integer = std::get_if<std::int64_t>(&number)) {
+      return Value::integer(*integer);
+    }
+    return std::get<double>(number);
+  }
+
+  /**
+   * @brief Creates an object and a value that refers to it
+   */
+  template <typename T, typename... Args>
+  [[nodiscard]] static auto make(Args&&... args) -> Value
+  {
+    static_assert(sizeof(T) <= Heap::max_small_size,
+                  "Heap objects must fit into the cells of a block");
+    const Object* object = new T(FWD(args)...);
+    Value value{object};
+    Heap::current().track(*object);
+    return value;
+  }
+
+  ~Value() { release(); }
+  Value(const Value& other) noexcept : bits_{other.bits_}
+  {
+    if (is_object()) { HeapObject::retain(object()); }
+  }
+  auto operator=(const Value& other) & noexcept -> Value&
+  {
+    Value copy{other};
+    std::swap(bits_, copy.bits_);
+    return *this;
+  }
+  Value(Value&& other) noexcept : bits_{std::exchange(other.bits_, null_bits)}
+  {}
+  auto operator=(Value&& other) & noexcept -> Value&
+  {
+    Value moved{MOV(other)};
+    std::swap(bits_, moved.bits_);
+    return *this;
+  }
+
+  /// @brief Whether the value is a number, either an integer or a double
+  [[nodiscard]] auto is_number() const noexcept -> bool
+  {
+    return is_double() || is_integer();
+  }
+  [[nodiscard]] auto is_double() const noexcept -> bool
+  {
+    return (bits_ & quiet_nan) != quiet_nan;
+  }
+  /// @brief Whether the value is an integer that is not boxed
+  [[nodiscard]] auto is_fixnum() const noexcept -> bool
+  {
+    return (bits_ & ~payload_mask) == fixnum_tag;
+  }
+  [[nodiscard]] auto is_integer() const noexcept -> bool
+  {
+    return is_fixnum() || (is_object() && object()->is_integer());
+  }
+  [[nodiscard]] auto is_boolean() const noexcept -> bool
+  {
+    return (bits_ | 1) == true_bits;
+  }
+  [[nodiscard]] auto is_null() const noexcept -> bool
+  {
+    return bits_ == null_bits;
+  }
+  [[nodiscard]] auto is_object() const noexcept -> bool
+  {
+    return (bits_ & object_tag) == object_tag;
+  }
+
+  /// @brief Gets a number as a double, which rounds large integers
+  [[nodiscard]] auto as_number() const noexcept -> double
+  {
+    return is_double() ? as_double() : static_cast<double>(as_integer());
+  }
+  [[nodiscard]] auto as_double() const noexcept -> double
+  {
+    return std::bit_cast<double>(bits_);
+  }
+  [[nodiscard]] auto as_fixnum() const noexcept -> std::int64_t
+  {
+    // Sign-extends the payload
+    return static_cast<std::int64_t>(bits_ << 16) >> 16;
+  }
+  [[nodiscard]] auto as_integer() const noexcept -> std::int64_t;
+  [[nodiscard]] auto as_boolean() const noexcept -> bool
+  {
+    return bits_ == true_bits;
+  }
+  /// @brief Gets the object this value refers to, or nullptr if there is none
+  [[nodiscard]] auto as_object() const noexcept -> const Object*
+  {
+    return is_object() ? object() : nullptr;
+  }
+  /// @brief Whether this is the only reference to an object
+  [[nodiscard]] auto is_unique() const noexcept -> bool
+  {
+    return is_object() && object()->ref_count_ == 1;
+  }
+
+  /// @brief Referential equality, as in eq?, except that numbers are compared
+  /// by value
+  [[nodiscard]] friend auto operator==(const Value& lhs,
+                                       const Value& rhs) noexcept -> bool
+  {
+    if (lhs.is_double() && rhs.is_double()) {
+      return lhs.as_double() == rhs.as_double();
+    }
+    if (lhs.bits_ == rhs.bits_) { return true; }
+    if (lhs.is_integer() && rhs.is_integer()) {
+      return lhs.as_integer() == rhs.as_integer();
+    }
+    if (lhs.is_number() && rhs.is_number()) {
+      return compare_numbers(lhs, rhs) == 0;
+    }
+    return false;
+  }
+
+  /// @brief Orders two numbers by their exact values
+  ///
+  /// Unlike converting both to double, an integer and a double that differ
+  /// only beyond the precision of a double do not compare equal.
+  [[nodiscard]] static auto compare_numbers(const Value& lhs,
+                                            const Value& rhs) noexcept
+      -> std::partial_ordering;
+
+private:
+  [[nodiscard]] static auto box(std::int64_t integer) -> Value;
+
+  [[nodiscard]] auto object() const noexcept -> const Object*
+  {
+    return reinterpret_cast<const Object*>(bits_ & ~object_tag);
+  }
+
+  void release() noexcept
+  {
+    if (is_object()) { HeapObject::release(object()); }
+  }
+};
+static_assert(sizeof(Value) == 8);
 
 /**
  * @brief A list of values
  */
 using Values = std::span<const Value>;
 
-#define OBJECT_ACCEPT                                                          \
-  void accept(ObjectVisitor& visitor) const override { visitor.visit(*this); }
-
 /**
  * @brief BuiltinProc wraps a native function that can be invoked from our
  * language
  */
 struct BuiltinProc : Object {
+  static constexpr auto object_type = ObjectType::builtin_proc;
+
   using NativeFunc = std::function<Value(Values)>;
   std::string name;
   NativeFunc native_func;
+  Intrinsic intrinsic_;
 
-  BuiltinProc(std::string name_, NativeFunc native_func_)
-      : name{std::move(name_)}, native_func{std::move(native_func_)}
+  BuiltinProc(std::string name_, NativeFunc native_func_,
+              Intrinsic intrinsic = Intrinsic::none)
+      : Object{object_type},
+        name{std::move(name_)},
+        native_func{std::move(native_func_)},
+        intrinsic_{intrinsic}
   {}
 
-  [[nodiscard]] auto is_procedural() const -> bool override { return true; }
-
-  OBJECT_ACCEPT
+  void trace(Tracer&) const override {}
+  void clear_references() override {}
 };
 
 /**
  * @brief a lisp procedural
+ *
+ * A procedural created by the virtual machine also carries the bytecode chunk
+ * compiled from its body, and one created by compiled closures carries the
+ * closures compiled from its body, or the native function that C++ code
+ * emitted by easylisp compiled it into.
  */
 struct Proc : Object {
-  std::vector<std::string> parameters;
+  static constexpr auto object_type = ObjectType::proc;
+
+  /// @brief The body of a procedural that was compiled ahead of time into C++
+  using NativeFunction = auto (*)(const EnvPtr& env, TailCall& tail) -> Value;
+
+  // Points into the lambda expression or the chunk that created the
+  // procedural, which body and chunk keep alive
+  std::span<const Symbol> parameters;
   ExprPtr body;
   EnvPtr env;
+  Ref<const Chunk> chunk;
+  Ref<const CompiledCode> code;
+  NativeFunction native = nullptr;
 
-  Proc(std::vector<std::string> parameters_, ExprPtr body_, EnvPtr env_)
-      : parameters(std::move(parameters_)), //
+  Proc(std::span<const Symbol> parameters_, ExprPtr body_, EnvPtr env_,
+       Ref<const Chunk> chunk_ = nullptr)
+      : Object{object_type},                //
+        parameters(parameters_),            //
         body(std::move(body_)),             //
-        env(std::move(env_))
+        env(std::move(env_)),               //
+        chunk(std::move(chunk_))
   {}
 
-  [[nodiscard]] auto is_procedural() const -> bool override { return true; }
+  Proc(std::span<const Symbol> parameters_, ExprPtr body_, EnvPtr env_,
+       Ref<const CompiledCode> code_)
+      : Object{object_type},                //
+        parameters(parameters_),            //
+        body(std::move(body_)),             //
+        env(std::move(env_)),               //
+        code(std::move(code_))
+  {}
+
+  Proc(std::span<const Symbol> parameters_, ExprPtr body_, EnvPtr env_,
+       NativeFunction native_)
+      : Object{object_type},                //
+        parameters(parameters_),            //
+        body(std::move(body_)),             //
+        env(std::move(env_)),               //
+        native(native_)
+  {}
+
+  /// @brief Whether the procedural runs as compiled closures
+  [[nodiscard]] auto is_compiled() const noexcept -> bool
+  {
+    return code || native != nullptr;
+  }
 
-  OBJECT_ACCEPT
+  void trace(Tracer& tracer) const override
+  {
+    tracer(body.arena());
+    tracer(env);
+    tracer(chunk);
+    tracer(code);
+  }
+  void clear_references() override
+  {
+    env = nullptr;
+    code = nullptr;
+  }
 };
 
 /**
  * @brief A pair
  */
 struct Cons : Object {
+  static constexpr auto object_type = ObjectType::cons;
+
   Value car;
   Value cdr;
   bool is_list_;
 
   Cons(Value car_, Value cdr_, bool is_list)
-      : car(std::move(car_)), cdr(std::move(cdr_)), is_list_{is_list}
+      : Object{object_type},
+        car(std::move(car_)),
+        cdr(std::move(cdr_)),
+        is_list_{is_list}
   {}
 
-  [[nodiscard]] auto is_pair() const -> bool override { return true; }
-  [[nodiscard]] auto is_list() const -> bool override { return is_list_; }
+  // Frees the tail of a list in a loop instead of recursively
+  ~Cons() override;
+  Cons(const Cons&) = delete;
+  auto operator=(const Cons&) & -> Cons& = delete;
+  Cons(Cons&&) = delete;
+  auto operator=(Cons&&) & -> Cons& = delete;
 
-  OBJECT_ACCEPT
+  void trace(Tracer& tracer) const override
+  {
+    tracer(car.as_object());
+    tracer(cdr.as_object());
+  }
+  void clear_references() override
+  {
+    car = nullptr;
+    cdr = nullptr;
+  }
 };
 
+/**
+ * @brief A lazy sequence, whose elements are computed one at a time while it
+ * is consumed instead of being stored
+ *
+ * A sequence is either a range of integers, or a map, filter or take over
+ * another sequence. Consuming a sequence again computes its elements again.
+ */
+struct Sequence : Object {
+  static constexpr auto object_type = ObjectType::sequence;
+
+  enum class Kind : std::uint8_t { range, map, filter, take };
+
+  Kind kind;
+  // The bounds of a range
+  std::int64_t lower = 0;
+  std::int64_t upper = 0;
+  // The sequence that a map, filter or take consumes
+  Value source;
+  // The procedural of a map or filter
+  Value proc;
+  // The number of elements of a take
+  std::size_t count = 0;
+
+  Sequence(std::int64_t lower_, std::int64_t upper_)
+      : Object{object_type}, kind{Kind::range}, lower{lower_}, upper{upper_}
+  {}
+
+  Sequence(Kind kind_, Value source_, Value proc_)
+      : Object{object_type},
+        kind{kind_},
+        source{std::move(source_)},
+        proc{std::move(proc_)}
+  {}
+
+  Sequence(Value source_, std::size_t count_)
+      : Object{object_type},
+        kind{Kind::take},
+        source{std::move(source_)},
+        count{count_}
+  {}
+
+  ~Sequence() override;
+  Sequence(const Sequence&) = delete;
+  auto operator=(const Sequence&) & -> Sequence& = delete;
+  Sequence(Sequence&&) = delete;
+  auto operator=(Sequence&&) & -> Sequence& = delete;
+
+  void trace(Tracer& tracer) const override
+  {
+    tracer(source.as_object());
+    tracer(proc.as_object());
+  }
+  void clear_references() override
+  {
+    source = nullptr;
+    proc = nullptr;
+  }
+};
+
+/**
+ * @brief An integer that does not fit into the payload of a value
+ */
+struct BoxedInteger : Object {
+  static constexpr auto object_type = ObjectType::boxed_integer;
+
+  std::int64_t value;
+
+  explicit BoxedInteger(std::int64_t value_)
+      : Object{object_type}, value{value_}
+  {}
+
+  void trace(Tracer&) const override {}
+  void clear_references() override {}
+};
+
+inline auto Object::intrinsic() const noexcept -> Intrinsic
+{
+  const auto* builtin = object_cast<BuiltinProc>(this);
+  return builtin ? builtin->intrinsic_ : Intrinsic::none;
+}
+
+inline auto Object::is_list() const noexcept -> bool
+{
+  const auto* cons = object_cast<Cons>(this);
+  return cons && cons->is_list_;
+}
+
+inline auto Value::integer(std::int64_t integer) -> Value
+{
+  if (integer < fixnum_min || integer > fixnum_max) { return box(integer); }
+  Value value;
+  value.bits_ =
+      fixnum_tag | (static_cast<std::uint64_t>(integer) & payload_mask);
+  return value;
+}
+
+inline auto Value::as_integer() const noexcept -> std::int64_t
+{
+  if (is_fixnum()) { return as_fixnum(); }
+  return static_cast<const BoxedInteger*>(object())->value;
+}
+
 [[nodiscard]] auto to_string(const Value& value) -> std::string;
 
 [[nodiscard]] auto is_number(const Value& value) -> bool;
@@ -123,5 +542,12 @@ struct Cons : Object {
 [[nodiscard]] auto is_pair(const Value& value) -> bool;
 [[nodiscard]] auto is_list(const Value& value) -> bool;
 [[nodiscard]] auto is_procedural(const Value& value) -> bool;
+[[nodiscard]] auto is_sequence(const Value& value) -> bool;
+
+/// @brief Converts a number to an integer, truncating a double towards zero
+/// and saturating it to the range of std::int64_t
+///
+/// @throws std::runtime_error if the number is NaN
+[[nodiscard]] auto to_integer(const Value& number) -> std::int64_t;
 
 #endif // EASYLISP_VALUE_HPP
@@ -0,0 +1,58 @@
+#include "value_stack.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+thread_local ValueStack* active_stack = nullptr;
+
+} // anonymous namespace
+
+ValueStack::Frame::~Frame()
+{
+  // Popped values must not keep their objects alive
+  std::ranges::fill(values_, Value{});
+  stack_.segment_ = saved_segment_;
+  stack_.top_ = saved_top_;
+}
+
+ValueStack::Activation::Activation(ValueStack& stack)
+    : saved_{std::exchange(active_stack, &stack)}
+{}
+
+ValueStack::Activation::~Activation() { active_stack = saved_; }
+
+ValueStack::ValueStack() { segments_.emplace_back(min_segment_size); }
+
+auto ValueStack::current() -> ValueStack&
+{
+  if (active_stack == nullptr) {
+    thread_local ValueStack stack;
+    return stack;
+  }
+  return *active_stack;
+}
+
+auto ValueStack::push(std::size_t size) -> Frame
+{
+  const auto saved_segment = segment_;
+  const auto saved_top = top_;
+
+  if (size > segments_[segment_].size - top_) {
+    // Every segment above the current one is empty
+    const auto next = segment_ + 1;
+    const auto segment_size = std::max(min_segment_size, size);
+    if (next == segments_.size()) {
+      segments_.emplace_back(segment_size);
+    } else if (segments_[next].size < size) {
+      segments_[next] = Segment{segment_size};
+    }
+    segment_ = next;
+    top_ = 0;
+  }
+
+  const std::span<Value> values{segments_[segment_].values.get() + top_, size};
+  top_ += size;
+  return Frame{*this, saved_segment, saved_top, values};
+}
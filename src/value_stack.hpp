@@ -0,0 +1,99 @@
+#ifndef EASYLISP_VALUE_STACK_HPP
+#define EASYLISP_VALUE_STACK_HPP
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "value.hpp"
+
+/**
+ * @brief A stack of values from which the arguments of calls are carved
+ *
+ * The stack grows in segments that never move, so a frame stays valid while
+ * more frames are pushed on top of it. Segments are kept when their frames are
+ * popped, which makes pushing a frame allocation free once the stack has grown
+ * to the depth of the program.
+ */
+class ValueStack {
+  static constexpr std::size_t min_segment_size = 4096;
+
+  struct Segment {
+    std::unique_ptr<Value[]> values;
+    std::size_t size = 0;
+
+    explicit Segment(std::size_t size_)
+        : values{std::make_unique<Value[]>(size_)}, size{size_}
+    {}
+  };
+
+  std::vector<Segment> segments_;
+  // The segment frames are currently pushed to
+  std::size_t segment_ = 0;
+  // The first free slot of the current segment
+  std::size_t top_ = 0;
+
+public:
+  /**
+   * @brief Contiguous values on top of the stack, popped on destruction
+   */
+  class Frame {
+    friend class ValueStack;
+
+    ValueStack& stack_;
+    std::size_t saved_segment_;
+    std::size_t saved_top_;
+    std::span<Value> values_;
+
+    Frame(ValueStack& stack, std::size_t saved_segment, std::size_t saved_top,
+          std::span<Value> values)
+        : stack_{stack}, saved_segment_{saved_segment}, saved_top_{saved_top},
+          values_{values}
+    {}
+
+  public:
+    ~Frame();
+    Frame(const Frame&) = delete;
+    auto operator=(const Frame&) & -> Frame& = delete;
+    Frame(Frame&&) = delete;
+    auto operator=(Frame&&) & -> Frame& = delete;
+
+    [[nodiscard]] auto values() const noexcept -> std::span<Value>
+    {
+      return values_;
+    }
+  };
+
+  /**
+   * @brief Makes a stack the current stack of this thread and restores the
+   * previous one on destruction
+   */
+  class Activation {
+    ValueStack* saved_;
+
+  public:
+    explicit Activation(ValueStack& stack);
+    ~Activation();
+    Activation(const Activation&) = delete;
+    auto operator=(const Activation&) & -> Activation& = delete;
+    Activation(Activation&&) = delete;
+    auto operator=(Activation&&) & -> Activation& = delete;
+  };
+
+  ValueStack();
+
+  /**
+   * @brief The value stack of the running interpreter
+   *
+   * Outside of an interpreter, every thread has a stack of its own.
+   */
+  [[nodiscard]] static auto current() -> ValueStack&;
+
+  /**
+   * @brief Pushes a frame of size null values
+   */
+  [[nodiscard]] auto push(std::size_t size) -> Frame;
+};
+
+#endif // EASYLISP_VALUE_STACK_HPP
@@ -0,0 +1,250 @@
+#include "vm.hpp"
+#include "interpreter.hpp"
+
+#include <stdexcept>
+
+namespace {
+
+// The number of call frames of all nested virtual machines on this thread
+thread_local std::size_t call_depth = 0;
+thread_local std::size_t max_depth = default_max_call_depth;
+
+// Assigns a new value to a variable and restores it when leaving the scope
+template <typename T> class ScopedAssign {
+  T& variable_;
+  T saved_;
+
+public:
+  ScopedAssign(T& variable, T value) : variable_{variable}, saved_{variable}
+  {
+    variable_ = value;
+  }
+  ~ScopedAssign() { variable_ = saved_; }
+  ScopedAssign(const ScopedAssign&) = delete;
+  auto operator=(const ScopedAssign&) -> ScopedAssign& = delete;
+  ScopedAssign(ScopedAssign&&) = delete;
+  auto operator=(ScopedAssign&&) -> ScopedAssign& = delete;
+};
+
+class VM {
+  struct CallFrame {
+    const Chunk* chunk = nullptr;
+    std::size_t pc = 0;
+    EnvPtr env;
+    // The stack index where the callee of this frame lives
+    std::size_t stack_base = 0;
+    // The size of saved_envs_ when entering this frame
+    std::size_t saved_envs_base = 0;
+  };
+
+  std::vector<Value> stack_;
+  std::vector<CallFrame> frames_;
+  std::vector<EnvPtr> saved_envs_;
+
+public:
+  [[nodiscard]] auto execute(const Chunk& chunk, EnvPtr env) -> Value
+  {
+    const auto stack_size = stack_.size();
+    const auto frames_size = frames_.size();
+    const auto saved_envs_size = saved_envs_.size();
+
+    push_frame(CallFrame{&chunk, 0, MOV(env), stack_size, saved_envs_size});
+    try {
+      return run(frames_size);
+    } catch (...) {
+      call_depth -= frames_.size() - frames_size;
+      stack_.resize(stack_size);
+      frames_.resize(frames_size);
+      saved_envs_.resize(saved_envs_size);
+      throw;
+    }
+  }
+
+private:
+  void push_frame(CallFrame frame)
+  {
+    if (call_depth >= max_depth) {
+      throw std::runtime_error{fmt::format(
+          "Runtime error: maximum recursion depth of {} exceeded", max_depth)};
+    }
+    ++call_depth;
+    frames_.push_back(MOV(frame));
+  }
+
+  void pop_frame()
+  {
+    --call_depth;
+    frames_.pop_back();
+  }
+
+  auto pop() -> Value
+  {
+    Value value = MOV(stack_.back());
+    stack_.pop_back();
+    return value;
+  }
+
+  [[nodiscard]] auto compiled_callee(std::size_t callee_index) const
+      -> const Proc*
+  {
+    const auto* proc =
+        object_cast<Proc>(stack_[callee_index].as_object());
+    return proc && proc->chunk ? proc : nullptr;
+  }
+
+  // Calls a procedure that is not compiled and replaces the callee and the
+  // arguments with the result
+  void call_native(std::size_t callee_index)
+  {
+    const Values args{stack_.data() + callee_index + 1,
+                      stack_.size() - callee_index - 1};
+    Value result = ::apply(stack_[callee_index], args);
+    stack_.resize(callee_index);
+    stack_.push_back(MOV(result));
+  }
+
+  void call(std::size_t arg_count)
+  {
+    const std::size_t callee_index = stack_.size() - arg_count - 1;
+    // Intrinsics run without going through the object visitor
+    if (const auto* obj = stack_[callee_index].as_object();
+        obj && obj->intrinsic() != Intrinsic::none) {
+      Value result =
+          apply_builtin(static_cast<const BuiltinProc&>(*obj),
+                        Values{stack_.data() + callee_index + 1, arg_count});
+      stack_.resize(callee_index);
+      stack_.push_back(MOV(result));
+      return;
+    }
+
+    const auto* proc = compiled_callee(callee_index);
+    if (!proc) {
+      call_native(callee_index);
+      return;
+    }
+
+    auto env = bind_arguments(
+        *proc, Values{stack_.data() + callee_index + 1, arg_count});
+    stack_.resize(callee_index + 1);
+    push_frame(CallFrame{proc->chunk.get(), 0, MOV(env), callee_index,
+                         saved_envs_.size()});
+  }
+
+  // Returns false if the callee is not compiled, in which case its result is
+  // left on the stack for the caller to return
+  [[nodiscard]] auto tail_call(std::size_t arg_count) -> bool
+  {
+    const std::size_t callee_index = stack_.size() - arg_count - 1;
+    const auto* proc = compiled_callee(callee_index);
+    if (!proc) {
+      call_native(callee_index);
+      return false;
+    }
+
+    auto& frame = frames_.back();
+    frame.env = bind_arguments(
+        *proc, Values{stack_.data() + callee_index + 1, arg_count});
+    frame.chunk = proc->chunk.get();
+    frame.pc = 0;
+    // The callee takes over the place of the caller, which keeps it alive
+    if (callee_index != frame.stack_base) {
+      stack_[frame.stack_base] = MOV(stack_[callee_index]);
+    }
+    stack_.resize(frame.stack_base + 1);
+    saved_envs_.resize(frame.saved_envs_base);
+    return true;
+  }
+
+  [[nodiscard]] auto run(std::size_t frames_size) -> Value
+  {
+    while (true) {
+      auto& frame = frames_.back();
+      const Chunk& chunk = *frame.chunk;
+      const Instruction instruction = chunk.code[frame.pc++];
+
+      switch (instruction.op) {
+      case OpCode::constant:
+        stack_.push_back(chunk.constants[instruction.operand]);
+        break;
+      case OpCode::load_local:
+        stack_.push_back(frame.env->lookup(
+            LexicalAddress{instruction.depth, instruction.operand}));
+        break;
+      case OpCode::load_global: {
+        const auto& name = chunk.names[instruction.operand];
+        const auto* val = frame.env->find_global(
+            name, chunk.global_caches[instruction.operand]);
+        if (!val) {
+          throw std::runtime_error(
+              fmt::format("ReferenceError: {} is not defined", name));
+        }
+        stack_.push_back(*val);
+      } break;
+      case OpCode::make_closure: {
+        const auto& child = chunk.chunks[instruction.operand];
+        stack_.push_back(Value::make<Proc>(
+            child->parameters, child->body,
+            capture_environment(child->captures, frame.env), child));
+      } break;
+      case OpCode::call:
+        call(instruction.operand);
+        break;
+      case OpCode::jump:
+        frame.pc = instruction.operand;
+        break;
+      case OpCode::jump_if_false:
+        if (!as_condition(pop())) { frame.pc = instruction.operand; }
+        break;
+      case OpCode::enter_let: {
+        const auto first = stack_.size() - instruction.operand;
+        auto let_env = make_ref<Environment>(
+            frame.env, Values{stack_.data() + first, instruction.operand});
+        stack_.resize(first);
+        saved_envs_.push_back(MOV(frame.env));
+        frame.env = MOV(let_env);
+      } break;
+      case OpCode::exit_let:
+        frame.env = MOV(saved_envs_.back());
+        saved_envs_.pop_back();
+        break;
+      case OpCode::tail_call:
+        if (tail_call(instruction.operand)) { break; }
+        [[fallthrough]];
+      case OpCode::return_: {
+        Value result = pop();
+        stack_.resize(frame.stack_base);
+        saved_envs_.resize(frame.saved_envs_base);
+        pop_frame();
+        if (frames_.size() == frames_size) { return result; }
+        stack_.push_back(MOV(result));
+      } break;
+      }
+    }
+  }
+};
+
+} // anonymous namespace
+
+auto execute(const Chunk& chunk, EnvPtr env) -> Value
+{
+  // Native procedures such as map can call back into the virtual machine while
+  // holding arguments on the stack of the caller, so every nesting level gets
+  // a virtual machine of its own
+  thread_local std::vector<std::unique_ptr<VM>> vms;
+  thread_local std::size_t nesting = 0;
+  // Each nesting level also takes a native frame, which the call depth of the
+  // virtual machine does not count
+  const NativeCallGuard guard;
+
+  if (nesting == vms.size()) { vms.push_back(std::make_unique<VM>()); }
+  auto& vm = *vms[nesting];
+  const ScopedAssign nesting_guard{nesting, nesting + 1};
+  return vm.execute(chunk, MOV(env));
+}
+
+auto execute(const Chunk& chunk, EnvPtr env, std::size_t max_call_depth)
+    -> Value
+{
+  const ScopedAssign max_depth_guard{max_depth, max_call_depth};
+  return execute(chunk, MOV(env));
+}
@@ -0,0 +1,27 @@
+#ifndef EASYLISP_VM_HPP
+#define EASYLISP_VM_HPP
+
+#include "bytecode.hpp"
+#include "environment.hpp"
+#include "value.hpp"
+
+/// @brief The default limit of nested procedural calls in the virtual machine
+inline constexpr std::size_t default_max_call_depth = 1'000'000;
+
+/**
+ * @brief Runs a chunk of bytecode in the environment env
+ *
+ * Call frames of the virtual machine live on the heap, so deep non-tail
+ * recursion is only limited by max_call_depth. Exceeding it raises a
+ * runtime_error.
+ */
+[[nodiscard]] auto execute(const Chunk& chunk, EnvPtr env,
+                           std::size_t max_call_depth) -> Value;
+
+/**
+ * @brief Runs a chunk of bytecode with the call depth limit of the virtual
+ * machine that is currently running
+ */
+[[nodiscard]] auto execute(const Chunk& chunk, EnvPtr env) -> Value;
+
+#endif // EASYLISP_VM_HPP
@@ -0,0 +1,63 @@
+// Replaces the global operator new to count allocations, which is why these
+// tests run in an executable of their own
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include "file_util.hpp"
+#include "interpreter.hpp"
+#include "parser.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+namespace {
+
+// The number of calls to the global operator new on this thread
+thread_local std::size_t allocation_count = 0;
+
+// The number of allocations made while interpreting a toplevel, which is
+// parsed beforehand
+[[nodiscard]] auto count_allocations(Interpreter& interpreter,
+                                     std::string_view source) -> std::size_t
+{
+  const auto program = parse(source);
+  const auto before = allocation_count;
+  interpreter.interpret(program);
+  return allocation_count - before;
+}
+
+} // anonymous namespace
+
+auto operator new(std::size_t size) -> void*
+{
+  ++allocation_count;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) { return ptr; }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+TEST_CASE("Procedure calls do not allocate once the interpreter is warm")
+{
+  const auto engine =
+      GENERATE(Engine::tree_walker, Engine::vm, Engine::closure);
+  Interpreter interpreter{InterpreterOptions{.engine = engine}};
+  std::ifstream file{EASYLISP_SCRIPTS_DIR "/fib.easylisp"};
+  REQUIRE(file.is_open());
+  interpreter.interpret(parse(file_to_string(file)));
+
+  // The compiling engines compile every toplevel, so the programs differ only
+  // in the number of calls they make
+  const auto run = [&](int n) {
+    return count_allocations(
+        interpreter,
+        fmt::format("(fib-rec {0}) (fib-fold {0}) (fib {0})", n));
+  };
+  const auto warm_up = run(20);
+  REQUIRE(run(10) <= warm_up);
+  REQUIRE(run(20) == run(10));
+  if (engine == Engine::tree_walker) { REQUIRE(run(20) == 0); }
+}
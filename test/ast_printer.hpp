@@ -2,6 +2,7 @@
 #define EASYLISP_TEST_AST_PRINTER_HPP
 
 #include <fmt/format.h>
+#include <span>
 
 #include "ast.hpp"
 
@@ -29,12 +30,22 @@ template <> struct fmt::formatter<Binding> {
   }
 };
 
+[[nodiscard]] inline auto to_strings(std::span<const Expr* const> exprs)
+    -> std::vector<std::string>
+{
+  std::vector<std::string> results;
+  for (const Expr* expr : exprs) { results.push_back(to_string(*expr)); }
+  return results;
+}
+
 struct ExprPrinter : ExprVisitor {
   std::string result;
 
   void visit(const NumberExpr& expr) override
   {
-    result = fmt::format("(const {})", expr.value);
+    result = std::visit(
+        [](auto value) { return fmt::format("(const {})", value); },
+        expr.value);
   }
 
   void visit(const VariableExpr& expr) override
@@ -44,20 +55,20 @@ struct ExprPrinter : ExprVisitor {
 
   void visit(const ApplyExpr& expr) override
   {
-    result =
-        fmt::format("(app {} {})", expr.func, fmt::join(expr.arguments, " "));
+    result = fmt::format("(app {} {})", to_string(*expr.func),
+                         fmt::join(to_strings(expr.arguments), " "));
   }
 
   void visit(const LambdaExpr& expr) override
   {
     result = fmt::format("(lambda ({}) {})", fmt::join(expr.parameters, " "),
-                         expr.body);
+                         to_string(*expr.body));
   }
 
   void visit(const LetExpr& expr) override
   {
-    result =
-        fmt::format("(let ({}) {})", fmt::join(expr.bindings, " "), expr.body);
+    result = fmt::format("(let ({}) {})", fmt::join(expr.bindings, " "),
+                         to_string(*expr.body));
   }
 
   void visit(const BooleanExpr& expr) override
@@ -67,8 +78,8 @@ struct ExprPrinter : ExprVisitor {
 
   void visit(const IfExpr& expr) override
   {
-    result = fmt::format("(if {} {} {})", expr.cond_expr, expr.if_expr,
-                         expr.else_expr);
+    result = fmt::format("(if {} {} {})", to_string(*expr.cond_expr),
+                         to_string(*expr.if_expr), to_string(*expr.else_expr));
   }
 };
 
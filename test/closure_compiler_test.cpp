@@ -0,0 +1,167 @@
+#include <catch2/catch.hpp>
+
+#include "fmt/format.h"
+#include "interpreter.hpp"
+#include "parser.hpp"
+
+namespace {
+
+[[nodiscard]] auto interpret_and_print(std::string_view source, Engine engine)
+    -> std::string
+{
+  Interpreter interpreter{InterpreterOptions{.engine = engine}};
+  std::vector<std::string> results;
+  try {
+    for (const auto& toplevel : parse(source)) {
+      if (auto value_opt = interpreter.interpret_toplevel(toplevel);
+          value_opt != std::nullopt) {
+        results.push_back(to_string(*value_opt));
+      }
+    }
+  } catch (const std::runtime_error& err) {
+    results.push_back(fmt::format("error: {}", err.what()));
+  }
+  return fmt::format("{}", fmt::join(results, "\n"));
+}
+
+[[nodiscard]] auto run_compiled(std::string_view source) -> std::string
+{
+  const auto result = interpret_and_print(source, Engine::closure);
+  REQUIRE(result == interpret_and_print(source, Engine::tree_walker));
+  return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Compiled closure evaluation")
+{
+  SECTION("constants and builtins")
+  {
+    REQUIRE(run_compiled("42") == "42");
+    REQUIRE(run_compiled("false") == "false");
+    REQUIRE(run_compiled("(+ 1 3 4)") == "8");
+    REQUIRE(run_compiled("(+ 1 3 4 5 6)") == "19");
+    REQUIRE(run_compiled("+") == "<builtin proc +>");
+  }
+
+  SECTION("applications of every arity")
+  {
+    REQUIRE(run_compiled("((lambda () 1))") == "1");
+    REQUIRE(run_compiled("((lambda (a) a) 1)") == "1");
+    REQUIRE(run_compiled("((lambda (a b) (- a b)) 1 2)") == "-1");
+    REQUIRE(run_compiled("((lambda (a b c) (- a b c)) 1 2 3)") == "-4");
+    REQUIRE(run_compiled("((lambda (a b c d) (- a b c d)) 1 2 3 4)") == "-8");
+  }
+
+  SECTION("lambda, let and closure")
+  {
+    REQUIRE(run_compiled("(lambda (x y) (+ x y))") == "<proc (x y)>");
+    REQUIRE(run_compiled("(((lambda (x) (lambda (y) (+ x y))) 3) 4)") == "7");
+    REQUIRE(run_compiled("(let ((x 1)) (let ((x 2) (y x)) (+ x y)))") == "3");
+    REQUIRE(run_compiled("(let ((f (let ((n 2)) (lambda (x) (* x n)))))"
+                         "  (f 21))") == "42");
+  }
+
+  SECTION("if expression")
+  {
+    REQUIRE(run_compiled("(if (< 10 20) 10 20)") == "10");
+    REQUIRE(run_compiled("(if (> 10 20) 10 20)") == "20");
+  }
+
+  SECTION("higher order builtins call back into compiled closures")
+  {
+    REQUIRE(run_compiled("(map (lambda (x) (+ x 1)) (list 1 2 3))") ==
+            "(2 3 4)");
+    REQUIRE(run_compiled("(foldl (lambda (x acc) (+ x acc)) 0 (range 0 5))") ==
+            "10");
+  }
+
+  SECTION("higher order builtins applied to lambda expressions run as loops")
+  {
+    REQUIRE(run_compiled("(let ((n 10))"
+                         "  (map (lambda (x) (* x n)) (range 1 4)))") ==
+            "(10 20 30)");
+    REQUIRE(run_compiled("(filter (lambda (x) (< x 3)) (list 1 5 2 4))") ==
+            "(1 2)");
+    REQUIRE(run_compiled("(filter (lambda (x) 0) (list 1 2))") == "(1 2)");
+    REQUIRE(run_compiled("(foldl (lambda (x acc) (cons x acc)) null "
+                         "(range 0 3))") == "(2 1 0)");
+    REQUIRE(run_compiled("(foldr (lambda (x acc) (cons x acc)) null "
+                         "(range 0 3))") == "(0 1 2)");
+    REQUIRE(run_compiled("(define loop (lambda (n) (if (eq? n 0) 0 "
+                         "(loop (- n 1)))))"
+                         "(map (lambda (x) (loop x)) (list 1000 2000))") ==
+            "(0 0)");
+    REQUIRE(run_compiled("(define map filter)"
+                         "(map (lambda (x) (< x 2)) (list 1 2 3))") == "(1)");
+    REQUIRE(run_compiled("(define f (lambda () (map (lambda (x) x) 1)))"
+                         "(f)") == "error: Type error: (list? 1) is false");
+    REQUIRE(run_compiled("(map (lambda (f) (f))"
+                         "  (map (lambda (x) (let ((y x)) (lambda () y)))"
+                         "    (list 1 2 3)))") == "(1 2 3)");
+    REQUIRE(run_compiled("(map (lambda (x y) x) (list 1))")
+                .ends_with("expected: 1, given: 2"));
+    REQUIRE(run_compiled("(foldl (lambda (x acc) (+ x acc)) 0 "
+                         "(list 1 true))") ==
+            "error: Type error: (number? true) is false");
+  }
+
+  SECTION("pipelines of higher order builtins run in a single traversal")
+  {
+    REQUIRE(run_compiled("(foldl + 0 (map (lambda (x) (* x x))"
+                         "  (filter (lambda (x) (< x 5)) (range 0 10))))") ==
+            "30");
+    REQUIRE(run_compiled("(let ((n 3))"
+                         "  (foldr cons null (map (lambda (x) (* x n))"
+                         "    (range 1 4))))") == "(3 6 9)");
+    REQUIRE(run_compiled("(filter (lambda (x) (> x 2))"
+                         "  (map (lambda (x) (* x 2)) (list 1 2 3)))") ==
+            "(4 6)");
+    REQUIRE(run_compiled("(map car (list (cons 1 2) (cons 3 4)))") == "(1 3)");
+    REQUIRE(run_compiled("(map (lambda (x) (+ x 1)) (range 5 0))") == "()");
+    REQUIRE(run_compiled("(define range (lambda (a b) (list a b)))"
+                         "(map (lambda (x) (+ x 1)) (range 0 5))") == "(1 6)");
+    REQUIRE(run_compiled("(define + -)"
+                         "(foldl (lambda (x acc) (+ x acc)) 0 (range 0 3))") ==
+            "1");
+    // The filter raises its error before the map runs
+    REQUIRE(run_compiled("(map (lambda (x) (+ x true))"
+                         "  (filter (lambda (x) (car x)) (range 0 3)))") ==
+            "error: Type error: (pair? 0) is false");
+    REQUIRE(run_compiled("(foldl + 0 (map car (range 0 3)))") ==
+            "error: Type error: (pair? 0) is false");
+    REQUIRE(run_compiled("(map (lambda (x) x) (range 0 true))") ==
+            "error: Type error: (number? true) is false");
+  }
+
+  SECTION("recursion with definition")
+  {
+    REQUIRE(run_compiled("(define fib (lambda (n)"
+                         "  (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))"
+                         "(fib 15)") == "610");
+  }
+
+  SECTION("tail calls run in constant native stack")
+  {
+    REQUIRE(run_compiled("(define loop (lambda (n acc)"
+                         "  (if (eq? n 0) acc"
+                         "      (let ((m (- n 1))) (loop m (+ acc 1))))))"
+                         "(loop 300000 0)") == "300000");
+  }
+
+  SECTION("errors")
+  {
+    REQUIRE(run_compiled("x") == "error: ReferenceError: x is not defined");
+    REQUIRE(run_compiled("(12)") == "error: Type error: Cannot apply to 12!");
+    REQUIRE(run_compiled("((list 1 2 3) 4)") ==
+            "error: Type error: cannot apply to cons cells");
+    REQUIRE(run_compiled("((lambda (x y) (+ x y)) 3 4 5)")
+                .starts_with("error: Type error: arity mismatch"));
+    REQUIRE(run_compiled("(if 1 10 20)")
+                .starts_with("error: Type error: 1 is not a boolean"));
+    REQUIRE(run_compiled("(define f (lambda (x) (car x))) (f 1)") ==
+            "error: Type error: (pair? 1) is false");
+    REQUIRE(run_compiled("(map (lambda (x) (+ x y)) (list 1 2))") ==
+            "error: ReferenceError: y is not defined");
+  }
+}
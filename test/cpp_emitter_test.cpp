@@ -0,0 +1,29 @@
+#include <catch2/catch.hpp>
+
+#include "ApprovalTests.hpp"
+
+#include "cpp_emitter.hpp"
+#include "parser.hpp"
+
+TEST_CASE("Emit C++")
+{
+  SECTION("definitions and expressions")
+  {
+    ApprovalTests::Approvals::verify(emit_cpp(parse(R"(
+(define answer 42)
+(print answer)
+)")));
+  }
+
+  SECTION("procedurals with captures, lets, ifs and tail calls")
+  {
+    ApprovalTests::Approvals::verify(emit_cpp(parse(R"(
+(define make-counter
+  (lambda (n)
+    (let ((step 1))
+      (lambda (x) (if (< x n) (+ x step) x)))))
+(define loop (lambda (n acc) (if (= n 0) acc (loop (- n 1) (+ acc n)))))
+(print (loop 10 0))
+)")));
+  }
+}
@@ -2,43 +2,67 @@
 
 #include "environment.hpp"
 
+#include <array>
+
 TEST_CASE("Global Environment")
 {
   Environment global_env{Environment::create_global_t{}};
 
   SECTION("+")
   {
-    const auto* plus = global_env.find("+");
+    const auto* plus = global_env.find(Symbol{"+"});
     REQUIRE(plus != nullptr);
-    REQUIRE(
-        dynamic_cast<const BuiltinProc&>(*std::get<ObjectPtr>(*plus)).name ==
-        "+");
+    REQUIRE(dynamic_cast<const BuiltinProc&>(*plus->as_object()).name == "+");
   }
 
   SECTION("None existing function")
   {
-    REQUIRE(global_env.find("fff") == nullptr);
+    REQUIRE(global_env.find(Symbol{"fff"}) == nullptr);
   }
 }
 
 TEST_CASE("Local Environment")
 {
-  Environment env{std::make_shared<Environment>(Environment::create_global)};
-  env.add("x", Value{42.0});
+  Environment env{make_ref<Environment>(Environment::create_global)};
+  env.add(Symbol{"x"}, Value{42.0});
 
   SECTION("Get local variable")
   {
-    const auto* x = env.find("x");
+    const auto* x = env.find(Symbol{"x"});
     REQUIRE(x != nullptr);
-    REQUIRE(std::get<double>(*x) == 42.0);
+    REQUIRE(x->as_number() == 42.0);
   }
 
   SECTION("Get variable from parent scope")
   {
-    const auto* plus = env.find("+");
+    const auto* plus = env.find(Symbol{"+"});
     REQUIRE(plus != nullptr);
-    REQUIRE(
-        dynamic_cast<const BuiltinProc&>(*std::get<ObjectPtr>(*plus)).name ==
-        "+");
+    REQUIRE(dynamic_cast<const BuiltinProc&>(*plus->as_object()).name == "+");
+  }
+}
+
+TEST_CASE("Global lookups from nested environments")
+{
+  const auto global = make_ref<Environment>(Environment::create_global);
+  global->add(Symbol{"x"}, Value{1.0});
+  EnvPtr env = global;
+  for (int i = 0; i < 10'000; ++i) {
+    env = make_ref<Environment>(MOV(env), std::array{Value{2.0}});
   }
-}
\ No newline at end of file
+  REQUIRE(&env->global() == global.get());
+
+  // Every reference site has a cache of its own
+  GlobalCache cache;
+  const auto lookup = [&] {
+    const auto* value = env->find_global(Symbol{"x"}, cache);
+    return value != nullptr ? value->as_number() : 0.0;
+  };
+  REQUIRE(lookup() == 1.0);
+  REQUIRE(cache.env == global.get());
+  REQUIRE(lookup() == 1.0);
+  global->add(Symbol{"x"}, Value{3.0});
+  REQUIRE(lookup() == 3.0);
+
+  GlobalCache undefined_cache;
+  REQUIRE(env->find_global(Symbol{"y"}, undefined_cache) == nullptr);
+}
@@ -0,0 +1,256 @@
+#include <catch2/catch.hpp>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "parser.hpp"
+
+#include <array>
+#include <memory_resource>
+#include <optional>
+
+namespace {
+
+// Counts the bytes that are allocated from it and not yet deallocated
+class CountingResource : public std::pmr::memory_resource {
+  std::size_t allocated_ = 0;
+
+  auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override
+  {
+    allocated_ += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* ptr, std::size_t bytes,
+                     std::size_t alignment) override
+  {
+    allocated_ -= bytes;
+    std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+  }
+
+  [[nodiscard]] auto
+  do_is_equal(const std::pmr::memory_resource& other) const noexcept
+      -> bool override
+  {
+    return this == &other;
+  }
+
+public:
+  [[nodiscard]] auto allocated() const noexcept -> std::size_t
+  {
+    return allocated_;
+  }
+};
+
+} // anonymous namespace
+
+TEST_CASE("Garbage collected heap")
+{
+  auto& heap = Heap::current();
+  heap.collect();
+  const auto object_count = heap.object_count();
+
+  SECTION("acyclic objects are freed by reference counting")
+  {
+    {
+      const Value list = Value::make<Cons>(1.0, nullptr, true);
+      REQUIRE(heap.object_count() == object_count + 1);
+    }
+    REQUIRE(heap.object_count() == object_count);
+  }
+
+  SECTION("the heap counts the live and free cells of every size")
+  {
+    const auto cons_cells = [&] {
+      for (const auto& size_class : heap.stats().size_classes) {
+        if (size_class.cell_size == Heap::cell_size(sizeof(Cons))) {
+          return size_class;
+        }
+      }
+      return HeapStats::SizeClass{};
+    };
+    const auto before = cons_cells();
+    {
+      const Value list = Value::make<Cons>(1.0, nullptr, true);
+      REQUIRE(cons_cells().live == before.live + 1);
+    }
+    REQUIRE(cons_cells().live == before.live);
+    REQUIRE(cons_cells().free >= 1);
+  }
+
+  SECTION("cycles are freed by the collector")
+  {
+    {
+      auto env = make_ref<Environment>(nullptr);
+      env->add(Symbol{"f"}, Value::make<Proc>(std::span<const Symbol>{},
+                                              nullptr, env));
+    }
+    REQUIRE(heap.object_count() == object_count + 2);
+    REQUIRE(heap.collect() == 2);
+    REQUIRE(heap.object_count() == object_count);
+  }
+
+  SECTION("reachable objects survive a collection")
+  {
+    const std::array parameters{Symbol{"x"}};
+    auto env = make_ref<Environment>(nullptr);
+    env->add(Symbol{"f"}, Value::make<Proc>(parameters, nullptr, env));
+    const Value list =
+        Value::make<Cons>(1.0, Value::make<Cons>(2.0, nullptr, true), true);
+
+    REQUIRE(heap.collect() == 0);
+    REQUIRE(to_string(*env->find(Symbol{"f"})) == "<proc (x)>");
+    REQUIRE(to_string(list) == "(1 2)");
+  }
+
+  SECTION("closures keep only their free variables alive")
+  {
+    for (const auto engine :
+         {Engine::tree_walker, Engine::vm, Engine::closure}) {
+      Interpreter interpreter{InterpreterOptions{.engine = engine}};
+      const auto program = parse("(define add-n"
+                                 "  (let ((big (range 0 10000)) (n 1))"
+                                 "    (lambda (x) (+ x n))))"
+                                 "(add-n 41)");
+      const auto builtins_count = heap.object_count();
+      interpreter.interpret_toplevel(program[0]);
+      heap.collect();
+      REQUIRE(heap.object_count() < builtins_count + 10);
+      REQUIRE(to_string(*interpreter.interpret_toplevel(program[1])) == "42");
+    }
+  }
+
+  SECTION("procedurals keep their program and its bytecode alive")
+  {
+    for (const auto engine : {Engine::tree_walker, Engine::vm}) {
+      Interpreter interpreter{InterpreterOptions{.engine = engine}};
+      interpreter.interpret(parse("(define make-adder"
+                                  "  (lambda (n) (lambda (x) (+ x n))))"
+                                  "(define add-1 (make-adder 1))"));
+      heap.collect();
+      const auto program = parse("(add-1 41)");
+      REQUIRE(to_string(*interpreter.interpret_toplevel(program[0])) == "42");
+    }
+  }
+
+  SECTION("an interpreter frees its definitions")
+  {
+    for (const auto engine :
+         {Engine::tree_walker, Engine::vm, Engine::closure}) {
+      {
+        Interpreter interpreter{InterpreterOptions{.engine = engine}};
+        interpreter.interpret(
+            parse("(define loop (lambda (n) (if (eq? n 0) 0 (loop (- n 1)))))"
+                  "(define lst (list 1 2 3))"
+                  "(define make-counter"
+                  "  (lambda (n) (lambda (x) (if (eq? x 0) n (loop x)))))"
+                  "(define counter (make-counter 4294967296000))"));
+      }
+      REQUIRE(heap.object_count() == object_count);
+    }
+  }
+
+  SECTION("the collector frees closure procedurals and their compiled code")
+  {
+    Interpreter interpreter{InterpreterOptions{.engine = Engine::closure}};
+    const auto program =
+        parse("(define f (lambda (n) (lambda (x) (f (+ n x)))))"
+              "(define g (f 1))"
+              "(define f 0)"
+              "(define g 0)");
+    interpreter.interpret_toplevel(program[0]);
+    heap.collect();
+    const auto defined_count = heap.object_count();
+    interpreter.interpret_toplevel(program[1]);
+    REQUIRE(heap.object_count() > defined_count);
+    interpreter.interpret_toplevel(program[2]);
+    interpreter.interpret_toplevel(program[3]);
+    heap.collect();
+    // The procedurals of f and g, their compiled code and their environments
+    // are gone
+    REQUIRE(heap.object_count() < defined_count);
+  }
+
+  SECTION("an interpreter can allocate from a memory resource and reset it")
+  {
+    CountingResource resource;
+    for (const auto engine :
+         {Engine::tree_walker, Engine::vm, Engine::closure}) {
+      Interpreter interpreter{InterpreterOptions{
+          .engine = engine, .memory_resource = &resource}};
+      const auto fresh = resource.allocated();
+      REQUIRE(fresh > 0);
+
+      interpreter.interpret(parse("(define lst (range 0 10000))"
+                                  "(define sum (lambda (l) (foldl + 0 l)))"));
+      REQUIRE(resource.allocated() > fresh);
+      const auto list = interpreter.interpret_toplevel(parse("lst")[0]);
+      REQUIRE(to_string(*interpreter.interpret_toplevel(
+                  parse("(sum lst)")[0])) == "49995000");
+
+      // The list that was returned is still alive
+      REQUIRE_FALSE(interpreter.reset());
+      REQUIRE(is_pair(*list));
+    }
+    REQUIRE(resource.allocated() == 0);
+
+    for (const auto engine :
+         {Engine::tree_walker, Engine::vm, Engine::closure}) {
+      Interpreter interpreter{InterpreterOptions{
+          .engine = engine, .memory_resource = &resource}};
+      interpreter.interpret(
+          interpreter.parse("(define lst (range 0 10000))"
+                            "(define add (lambda (n) (lambda (x) (+ n x))))"
+                            "(define add-lst (add (foldl + 0 lst)))"));
+      REQUIRE(interpreter.reset());
+      REQUIRE(resource.allocated() == 0);
+      REQUIRE(interpreter.reset());
+    }
+
+    Interpreter interpreter{InterpreterOptions{.memory_resource = &resource}};
+    interpreter.interpret(parse("(define lst (range 0 10000))"));
+    REQUIRE(interpreter.reset());
+    REQUIRE(resource.allocated() == 0);
+    REQUIRE_THROWS(interpreter.interpret_toplevel(parse("lst")[0]));
+    REQUIRE(to_string(*interpreter.interpret_toplevel(
+                parse("(foldl + 0 (range 0 5))")[0])) == "10");
+  }
+
+  SECTION("the heap of an interpreter outlives it while its values do")
+  {
+    CountingResource resource;
+    std::optional<Value> list;
+    {
+      Interpreter interpreter{
+          InterpreterOptions{.memory_resource = &resource}};
+      list = interpreter.interpret_toplevel(parse("(range 0 10000)")[0]);
+    }
+    REQUIRE(resource.allocated() > 0);
+    REQUIRE(to_string(*list).starts_with("(0 1 2"));
+    list.reset();
+    REQUIRE(resource.allocated() == 0);
+  }
+
+  SECTION("a reset interpreter lets a monotonic resource be released")
+  {
+    CountingResource upstream;
+    std::pmr::monotonic_buffer_resource resource{&upstream};
+    Interpreter interpreter{InterpreterOptions{.memory_resource = &resource}};
+    const auto object_count_before = heap.object_count();
+    for (int request = 0; request < 3; ++request) {
+      {
+        const auto program =
+            interpreter.parse("(define lst (range 0 10000))"
+                              "(define sum (lambda (l) (foldl + 0 l)))");
+        interpreter.interpret(program);
+        REQUIRE(to_string(*interpreter.interpret_toplevel(
+                    interpreter.parse("(sum lst)")[0])) == "49995000");
+      }
+      REQUIRE(upstream.allocated() > 0);
+      REQUIRE(interpreter.reset());
+      resource.release();
+      REQUIRE(upstream.allocated() == 0);
+    }
+    // Neither the programs nor the environments used the heap of the thread
+    REQUIRE(heap.object_count() == object_count_before);
+  }
+}
@@ -181,6 +181,167 @@ TEST_CASE("List evaluation test")
             "(foldr (lambda (x acc) (* (+ acc 1) x)) 0 (list 1 2 3 4 5))") ==
         "153");
   }
+
+  SECTION("lists of millions of elements are compared, printed and freed "
+          "without recursion")
+  {
+    REQUIRE(interpret_and_print(
+                "(equal? (range 0 2000000) (range 0 2000000))") == "true");
+    REQUIRE(interpret_and_print(
+                "(equal? (range 0 2000000) (range 0 1999999))") == "false");
+    REQUIRE(interpret_and_print("(range 0 2000000)")
+                .ends_with(" 1999998 1999999)"));
+    REQUIRE(interpret_and_print("(car (foldl cons null (range 0 2000000)))") ==
+            "1999999");
+  }
+}
+
+TEST_CASE("Integer arithmetic test")
+{
+  SECTION("integers stay exact beyond 2^53")
+  {
+    REQUIRE(interpret_and_print("(+ 9007199254740992 1)") ==
+            "9007199254740993");
+    REQUIRE(interpret_and_print("(* 3037000499 3037000499)") ==
+            "9223372030926249001");
+    REQUIRE(interpret_and_print("(- -9223372036854775807 1)") ==
+            "-9223372036854775808");
+    REQUIRE(interpret_and_print("(< 9007199254740992 9007199254740993)") ==
+            "true");
+    REQUIRE(interpret_and_print("(eq? 9007199254740993 9007199254740993)") ==
+            "true");
+  }
+
+  SECTION("overflows, fractions and doubles make doubles")
+  {
+    REQUIRE(interpret_and_print("(+ 9223372036854775807 1)") ==
+            "9.223372036854776e+18");
+    REQUIRE(interpret_and_print("(* 4294967296 4294967296)") ==
+            "1.8446744073709552e+19");
+    REQUIRE(interpret_and_print("(/ 6 3)") == "2");
+    REQUIRE(interpret_and_print("(/ 7 2)") == "3.5");
+    REQUIRE(interpret_and_print("(/ 1 0)") == "inf");
+    REQUIRE(interpret_and_print("(+ 1 0.5)") == "1.5");
+    REQUIRE(interpret_and_print("(eq? 1 1.0)") == "true");
+    REQUIRE(interpret_and_print("(range 1.5 4)") == "(1 2 3)");
+  }
+
+  SECTION("huge doubles are clamped to integers")
+  {
+    REQUIRE(interpret_and_print("(range 1e30 3)") == "()");
+    REQUIRE(interpret_and_print("(range 3 -1e30)") == "()");
+    REQUIRE(interpret_and_print("(range (/ 1 0) 3)") == "()");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (take (in-range -1e30 0) 2))") ==
+            "(-9223372036854775808 -9223372036854775807)");
+    REQUIRE_THROWS_WITH(interpret_and_print("(range 0 (- (/ 0 0)))"),
+                        Catch::StartsWith("Type error: "));
+    REQUIRE_THROWS_WITH(interpret_and_print("(in-range (/ 0 0) 1)"),
+                        Catch::StartsWith("Type error: "));
+  }
+
+  SECTION("integers and doubles are compared exactly")
+  {
+    REQUIRE(interpret_and_print(
+                "(eq? 9007199254740993 9007199254740992.0)") == "false");
+    REQUIRE(interpret_and_print(
+                "(equal? 9007199254740993 9007199254740992.0)") == "false");
+    REQUIRE(interpret_and_print(
+                "(eq? 9007199254740992 9007199254740992.0)") == "true");
+    REQUIRE(interpret_and_print(
+                "(< 9007199254740992.0 9007199254740993)") == "true");
+    REQUIRE(interpret_and_print(
+                "(>= 9007199254740992.0 9007199254740993)") == "false");
+    REQUIRE(interpret_and_print(
+                "(> 9223372036854775807 9223372036854775807.0)") == "false");
+    REQUIRE(interpret_and_print(
+                "(< -9223372036854775808 -9223372036854775808.0)") ==
+            "false");
+    REQUIRE(interpret_and_print("(<= -9223372036854775808 -1e19)") ==
+            "false");
+    REQUIRE(interpret_and_print("(< 1 1.5)") == "true");
+    REQUIRE(interpret_and_print("(> -1 -1.5)") == "true");
+    REQUIRE(interpret_and_print("(< -2 -1.5)") == "true");
+    REQUIRE(interpret_and_print("(< 1 (/ 1 0))") == "true");
+    REQUIRE(interpret_and_print("(< 1 (- 0 (/ 1 0)))") == "false");
+  }
+}
+
+TEST_CASE("Lazy sequence test")
+{
+  SECTION("sequences are computed when they are consumed")
+  {
+    REQUIRE(interpret_and_print("(in-range 0 5)") == "<sequence>");
+    REQUIRE(interpret_and_print("(sequence->list (in-range 0 5))") ==
+            "(0 1 2 3 4)");
+    REQUIRE(interpret_and_print("(sequence->list (in-range 5 0))") == "()");
+    REQUIRE(interpret_and_print("(sequence->list (list 1 2))") == "(1 2)");
+    REQUIRE(interpret_and_print("(sequence? (in-range 0 5))") == "true");
+    REQUIRE(interpret_and_print("(sequence? (list 1 2))") == "false");
+    REQUIRE(interpret_and_print("(list? (in-range 0 5))") == "false");
+  }
+
+  SECTION("map, filter and take over sequences are lazy")
+  {
+    REQUIRE(interpret_and_print("(map (lambda (x) (+ x 1)) (in-range 0 3))") ==
+            "<sequence>");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (filter (lambda (x) (> x 2))"
+                "  (map (lambda (x) (* x 2)) (in-range 0 4))))") == "(4 6)");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (take (map (lambda (x) (car x))"
+                "  (in-range 0 1000000000)) 0))") == "()");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (take (in-range 0 1000000000) 3))") ==
+            "(0 1 2)");
+    REQUIRE(interpret_and_print("(take (list 1 2 3) 2)") == "(1 2)");
+    REQUIRE(interpret_and_print("(take (list 1 2 3) 5)") == "(1 2 3)");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (take (take (in-range 0 10) 5) 3))") ==
+            "(0 1 2)");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (filter (lambda (x) (> x 1))"
+                "  (take (in-range 0 10) 3)))") == "(2)");
+  }
+
+  SECTION("take counts are clamped")
+  {
+    REQUIRE(interpret_and_print("(take (list 1 2) (/ 1 0))") == "(1 2)");
+    REQUIRE(interpret_and_print("(take (list 1 2) (/ -1 0))") == "()");
+    REQUIRE(interpret_and_print("(take (list 1 2) -3)") == "()");
+    REQUIRE(interpret_and_print("(take (list 1 2) 1.5)") == "(1)");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (take (in-range 0 3) 1e300))") == "(0 1 2)");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (take (in-range 0 1e300) 3))") == "(0 1 2)");
+    REQUIRE(interpret_and_print(
+                "(sequence->list (take"
+                "  (map (lambda (x) (* x x)) (in-range 0 (/ 1 0))) 4))") ==
+            "(0 1 4 9)");
+    REQUIRE_THROWS_WITH(
+        interpret_and_print("(take (list 1 2) (- (/ 1 0) (/ 1 0)))"),
+        Catch::StartsWith("Type error: "));
+  }
+
+  SECTION("deeply nested sequences do not nest native calls")
+  {
+    REQUIRE(interpret_and_print(
+                "(define deep (foldl (lambda (x s)"
+                "                      (map (lambda (y) (+ y 1)) s))"
+                "  (in-range 0 1000000000) (range 0 200000)))"
+                "(sequence->list (take deep 2))"
+                "(foldl + 0"
+                "  (take (filter (lambda (x) (> x 200001)) deep) 2))") ==
+            "(200000 200001)\n400005");
+  }
+
+  SECTION("foldl consumes sequences one element at a time")
+  {
+    REQUIRE(interpret_and_print("(foldl + 0 (in-range 0 100001))") ==
+            "5000050000");
+    REQUIRE(interpret_and_print("(foldl + 0 (take (filter (lambda (x) (< x 5))"
+                                "  (in-range 0 1000000000)) 3))") == "3");
+  }
 }
 
 TEST_CASE("Type predicate test")
@@ -271,10 +432,139 @@ TEST_CASE("Definition test")
                                 "(+ x 1)") == "43");
   }
 
+  SECTION("global variables are late-bound")
+  {
+    REQUIRE(interpret_and_print("(define f (lambda (x) (g x)))"
+                                "(define g (lambda (x) (+ x 1)))"
+                                "(f 1)"
+                                "(define g (lambda (x) (+ x 2)))"
+                                "(f 1)") == "2\n3");
+  }
+
+  SECTION("local variables shadow global variables")
+  {
+    REQUIRE(interpret_and_print("(define x 100)"
+                                "((lambda (x) (let ((y x)) (+ x y))) 1)") ==
+            "2");
+  }
+
   SECTION("Recursion with definition")
   {
     REQUIRE(interpret_and_print(
                 "(define fact (lambda (x) (if (< x 2) x (* x (fact (- x 1))))))"
                 "(fact 10)") == "3628800");
   }
-}
\ No newline at end of file
+
+  SECTION("cached globals are not shared between interpreters")
+  {
+    for (const auto engine : {Engine::tree_walker, Engine::vm}) {
+      const auto program = parse("(+ x 1)");
+      Interpreter first{InterpreterOptions{.engine = engine}};
+      first.interpret(parse("(define x 1)"));
+      Interpreter second{InterpreterOptions{.engine = engine}};
+      second.interpret(parse("(define x 10)"));
+      REQUIRE(to_string(*first.interpret_toplevel(program[0])) == "2");
+      REQUIRE(to_string(*second.interpret_toplevel(program[0])) == "11");
+      first.interpret(parse("(define x 100)"));
+      REQUIRE(to_string(*first.interpret_toplevel(program[0])) == "101");
+    }
+  }
+
+  SECTION("procedurals outlive the program that defines them")
+  {
+    for (const auto engine : {Engine::tree_walker, Engine::vm}) {
+      Interpreter interpreter{InterpreterOptions{.engine = engine}};
+      interpreter.interpret(
+          parse("(define add (lambda (x) (lambda (y) (+ x y))))"));
+      interpreter.interpret(parse("(define add1 (add 1))"));
+      const auto program = parse("(add1 41)");
+      REQUIRE(to_string(*interpreter.interpret_toplevel(program[0])) == "42");
+    }
+  }
+}
+
+TEST_CASE("Call depth limit")
+{
+  constexpr std::string_view sum =
+      "(define sum (lambda (n) (if (eq? n 0) 0 (+ n (sum (- n 1))))))";
+
+  SECTION("exceeding the call depth limit is a runtime error")
+  {
+    for (const auto engine : {Engine::tree_walker, Engine::closure}) {
+      Interpreter interpreter{
+          InterpreterOptions{.engine = engine, .max_call_depth = 1000}};
+      const auto program = parse(fmt::format("{} (sum 5000) (sum 500)", sum));
+      interpreter.interpret_toplevel(program[0]);
+      REQUIRE_THROWS_WITH(
+          interpreter.interpret_toplevel(program[1]),
+          "Runtime error: maximum recursion depth of 1000 exceeded");
+      REQUIRE(to_string(*interpreter.interpret_toplevel(program[2])) ==
+              "125250");
+    }
+  }
+
+  SECTION("recursion that would overflow the native stack is an error")
+  {
+    for (const auto engine : {Engine::tree_walker, Engine::closure}) {
+      Interpreter interpreter{InterpreterOptions{.engine = engine}};
+      const auto program = parse(fmt::format("{} (sum 500000) (sum 100)", sum));
+      interpreter.interpret_toplevel(program[0]);
+      REQUIRE_THROWS_WITH(interpreter.interpret_toplevel(program[1]),
+                          Catch::StartsWith("Runtime error: maximum recursion "
+                                            "depth exceeded, the native stack "
+                                            "ran out"));
+      REQUIRE(to_string(*interpreter.interpret_toplevel(program[2])) ==
+              "5050");
+    }
+  }
+
+  SECTION("recursion through builtins that call back is limited")
+  {
+    for (const auto engine :
+         {Engine::tree_walker, Engine::vm, Engine::closure}) {
+      Interpreter interpreter{InterpreterOptions{.engine = engine}};
+      const auto program =
+          parse("(define g (lambda (n) (if (eq? n 0) 0"
+                "  (car (map (lambda (x) (+ 1 (g (- n 1)))) (list 1))))))"
+                "(g 200000) (g 100)");
+      interpreter.interpret_toplevel(program[0]);
+      REQUIRE_THROWS_WITH(
+          interpreter.interpret_toplevel(program[1]),
+          Catch::StartsWith("Runtime error: maximum recursion depth"));
+      REQUIRE(to_string(*interpreter.interpret_toplevel(program[2])) ==
+              "100");
+    }
+
+    Interpreter interpreter{
+        InterpreterOptions{.engine = Engine::vm, .max_call_depth = 1000}};
+    const auto program =
+        parse("(define g (lambda (n) (if (eq? n 0) 0"
+              "  (car (map (lambda (x) (+ 1 (g (- n 1)))) (list 1))))))"
+              "(g 5000)");
+    interpreter.interpret_toplevel(program[0]);
+    REQUIRE_THROWS_WITH(
+        interpreter.interpret_toplevel(program[1]),
+        "Runtime error: maximum recursion depth of 1000 exceeded");
+  }
+}
+
+TEST_CASE("Tail call test")
+{
+  SECTION("tail recursion runs in constant stack")
+  {
+    REQUIRE(interpret_and_print(
+                "(define loop (lambda (n acc)"
+                "  (if (eq? n 0) acc (loop (- n 1) (+ acc 1)))))"
+                "(loop 300000 0)") == "300000");
+  }
+
+  SECTION("tail calls through let and mutual recursion")
+  {
+    REQUIRE(interpret_and_print(
+                "(define even? (lambda (n)"
+                "  (if (eq? n 0) true (let ((m (- n 1))) (odd? m)))))"
+                "(define odd? (lambda (n)"
+                "  (if (eq? n 0) false (let ((m (- n 1))) (even? m)))))"
+                "(even? 300001)") == "false");
+  }
+}
@@ -0,0 +1,241 @@
+#include <catch2/catch.hpp>
+
+#include <fmt/format.h>
+
+#include "ast_printer.hpp"
+#include "interpreter.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+
+namespace {
+
+[[nodiscard]] auto
+optimize_and_print(std::string_view source,
+                   OptimizationLevel level = OptimizationLevel::O1)
+    -> std::string
+{
+  const auto global = make_ref<Environment>(Environment::create_global);
+  return fmt::format("{}",
+                     fmt::join(optimize(parse(source), *global, level), "\n"));
+}
+
+[[nodiscard]] auto interpret_and_print(std::string_view source,
+                                       InterpreterOptions options)
+    -> std::string
+{
+  Interpreter interpreter{options};
+  std::vector<std::string> results;
+  try {
+    for (const auto& toplevel : parse(source)) {
+      if (auto value_opt = interpreter.interpret_toplevel(toplevel);
+          value_opt != std::nullopt) {
+        results.push_back(to_string(*value_opt));
+      }
+    }
+  } catch (const std::runtime_error& err) {
+    results.push_back(fmt::format("error: {}", err.what()));
+  }
+  return fmt::format("{}", fmt::join(results, "\n"));
+}
+
+// Runs source with and without optimizations, which should agree
+[[nodiscard]] auto
+run_optimized(std::string_view source,
+              OptimizationLevel level = OptimizationLevel::O1) -> std::string
+{
+  const auto engine =
+      GENERATE(Engine::tree_walker, Engine::vm, Engine::closure);
+  const auto result =
+      interpret_and_print(source, {.engine = engine, .optimization = level});
+  REQUIRE(result == interpret_and_print(source, {.engine = engine}));
+  return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Constant folding")
+{
+  SECTION("constant applications of builtins are folded")
+  {
+    REQUIRE(optimize_and_print("(+ 1 2 3)") == "(const 6)");
+    REQUIRE(optimize_and_print("(< (* 2 3) 7)") == "(const true)");
+    REQUIRE(optimize_and_print("(not (eq? 1 1))") == "(const false)");
+    REQUIRE(optimize_and_print("(let ((x 1)) (* (+ 1 1) x))") == "(const 2)");
+  }
+
+  SECTION("builtins are not folded in procedure bodies, which may run after "
+          "later toplevels redefine them")
+  {
+    REQUIRE(optimize_and_print("(lambda (x) (* (+ 1 1) x))") ==
+            "(lambda (x) (app (var *) (app (var +) (const 1) (const 1)) "
+            "(var x)))");
+    REQUIRE(run_optimized("(define h (lambda () (+ 1 2)))"
+                          "(define + -)"
+                          "(h)") == "-1");
+
+    Interpreter interpreter{
+        InterpreterOptions{.optimization = OptimizationLevel::O1}};
+    interpreter.interpret(parse("(define h (lambda () (if (< 1 2) 1 2)))"));
+    interpreter.interpret(parse("(define < >)"));
+    REQUIRE(to_string(*interpreter.interpret_toplevel(parse("(h)")[0])) ==
+            "2");
+  }
+
+  SECTION("applications that raise errors are left to run")
+  {
+    REQUIRE(optimize_and_print("(+ 1 true)") ==
+            "(app (var +) (const 1) (const true))");
+    REQUIRE(optimize_and_print("(car 1)") == "(app (var car) (const 1))");
+    REQUIRE(run_optimized("(+ 1 true)") ==
+            "error: Type error: (number? true) is false");
+  }
+
+  SECTION("builtins that the program redefines or shadows are not folded")
+  {
+    REQUIRE(optimize_and_print("(define + -) (+ 1 2)") ==
+            "(define + (var -))\n(app (var +) (const 1) (const 2))");
+    REQUIRE(optimize_and_print("(lambda (+) (+ 1 2))") ==
+            "(lambda (+) (app (var +) (const 1) (const 2)))");
+    REQUIRE(run_optimized("(define + -) (+ 1 2)") == "-1");
+
+    const auto global = make_ref<Environment>(Environment::create_global);
+    global->add(Symbol{"+"}, *global->find(Symbol{"-"}));
+    const auto program =
+        optimize(parse("(+ 1 2)"), *global, OptimizationLevel::O1);
+    REQUIRE(fmt::format("{}", program.front()) ==
+            "(app (var +) (const 1) (const 2))");
+  }
+
+  SECTION("if expressions with a constant condition are pruned")
+  {
+    REQUIRE(optimize_and_print("(if (< 1 2) (f 1) (f 2))") ==
+            "(app (var f) (const 1))");
+    REQUIRE(optimize_and_print("(if false 1 2)") == "(const 2)");
+    REQUIRE(optimize_and_print("(if 1 2 3)") ==
+            "(if (const 1) (const 2) (const 3))");
+    REQUIRE(run_optimized("(if 1 2 3)").starts_with("error: Type error"));
+  }
+
+  SECTION("constant let bindings are substituted")
+  {
+    REQUIRE(optimize_and_print("(let ((x 2) (y (+ 1 2))) (* x y))") ==
+            "(const 6)");
+    REQUIRE(optimize_and_print("(lambda (z) (let ((x 2)) (* x z)))") ==
+            "(lambda (z) (app (var *) (const 2) (var z)))");
+    REQUIRE(optimize_and_print("(let ((x 1)) (let ((x 2)) x))") ==
+            "(const 2)");
+    REQUIRE(optimize_and_print("(lambda (z) (let ((x z)) (+ x x)))") ==
+            "(lambda (z) (app (var +) (var z) (var z)))");
+    REQUIRE(optimize_and_print(
+                "(lambda (z) (let ((x z)) (lambda (z) (+ x z))))") ==
+            "(lambda (z) (let ((x (var z))) (lambda (z) "
+            "(app (var +) (var x) (var z)))))");
+  }
+
+  SECTION("unused let bindings are removed unless they can fail")
+  {
+    REQUIRE(optimize_and_print(
+                "(lambda (y) (let ((x y) (f (lambda () 1))) y))") ==
+            "(lambda (y) (var y))");
+    REQUIRE(optimize_and_print("(let ((x (g 1)) (y 2)) 3)") ==
+            "(let ((x (app (var g) (const 1)))) (const 3))");
+    REQUIRE(optimize_and_print("(let ((x undefined)) 3)") ==
+            "(let ((x (var undefined))) (const 3))");
+  }
+
+  SECTION("optimized programs run like the original")
+  {
+    REQUIRE(run_optimized(R"(
+(define f (lambda (n) (let ((k (* 2 3)) (unused n)) (if (< 1 2) (+ n k) 0))))
+(f 1)
+(let ((x 1)) (let ((g (lambda (y) (+ x y)))) (g (f x))))
+(let ((x 1)) (let ((x 2) (y x)) (- x y)))
+)") == "7\n8\n1");
+  }
+}
+
+TEST_CASE("Inlining")
+{
+  constexpr auto O2 = OptimizationLevel::O2;
+
+  SECTION("applications of lambda expressions are inlined")
+  {
+    REQUIRE(optimize_and_print("((lambda (x y) (+ x y)) 1 2)", O2) ==
+            "(const 3)");
+    REQUIRE(optimize_and_print("(lambda (z) ((lambda (x) (* x x)) z))", O2) ==
+            "(lambda (z) (app (var *) (var z) (var z)))");
+    REQUIRE(optimize_and_print("((lambda (x) x) 1 2)", O2) ==
+            "(app (lambda (x) (var x)) (const 1) (const 2))");
+  }
+
+  SECTION("small global procedures are inlined into code that runs right "
+          "away after their definition")
+  {
+    REQUIRE(optimize_and_print(R"(
+(define abs (lambda (x) (if (< x 0) (- x) x)))
+(lambda (y) (abs y))
+(abs -3)
+)",
+                               O2) ==
+            "(define abs (lambda (x) (if (app (var <) (var x) (const 0)) "
+            "(app (var -) (var x)) (var x))))\n"
+            "(lambda (y) (app (var abs) (var y)))\n"
+            "(const 3)");
+    REQUIRE(optimize_and_print("(define f (lambda () (g))) "
+                               "(define g (lambda () 1)) (f)",
+                               O2) ==
+            "(define f (lambda () (app (var g) )))\n"
+            "(define g (lambda () (const 1)))\n"
+            "(const 1)");
+  }
+
+  SECTION("procedures that are recursive, redefined or shadowed are not "
+          "inlined")
+  {
+    REQUIRE(optimize_and_print(R"(
+(define loop (lambda (n) (if (= n 0) 0 (loop (- n 1)))))
+(loop 1)
+)",
+                               O2)
+                .ends_with("\n(app (var loop) (const 1))"));
+    REQUIRE(optimize_and_print(
+                "(define f (lambda () 1)) (f) (define f (lambda () 2))", O2) ==
+            "(define f (lambda () (const 1)))\n(app (var f) )\n"
+            "(define f (lambda () (const 2)))");
+    REQUIRE(optimize_and_print(
+                "(define f (lambda (x) (g x))) (lambda (g) (f 1))", O2)
+                .ends_with("\n(lambda (g) (app (var f) (const 1)))"));
+    REQUIRE(optimize_and_print("(define f (lambda (x) x)) (f 1 2)", O2)
+                .ends_with("\n(app (var f) (const 1) (const 2))"));
+  }
+
+  SECTION("procedure bodies do not inline procedures that a later program "
+          "may redefine")
+  {
+    for (const auto engine :
+         {Engine::tree_walker, Engine::vm, Engine::closure}) {
+      Interpreter interpreter{InterpreterOptions{.engine = engine,
+                                                 .optimization = O2}};
+      interpreter.interpret(parse("(define f (lambda (x) (* 2 x)))"
+                                  "(define g (lambda () (f 10)))"));
+      interpreter.interpret(parse("(define f (lambda (x) 0))"));
+      REQUIRE(to_string(*interpreter.interpret_toplevel(parse("(g)")[0])) ==
+              "0");
+    }
+  }
+
+  SECTION("inlined programs run like the original")
+  {
+    REQUIRE(run_optimized(R"(
+(define square (lambda (x) (* x x)))
+(define sum-of-squares (lambda (x y) (+ (square x) (square y))))
+(sum-of-squares 3 4)
+(define x 10)
+(let ((y 2)) (sum-of-squares x y))
+((lambda (x) (let ((y x)) ((lambda (x) (- x y)) 1))) 5)
+(square true)
+)",
+                          O2) ==
+            "25\n104\n-4\nerror: Type error: (number? true) is false");
+  }
+}
@@ -0,0 +1,133 @@
+#include <catch2/catch.hpp>
+
+#include <fmt/format.h>
+
+#include "parser.hpp"
+
+namespace {
+
+struct AddressCollector : ExprVisitor {
+  std::vector<std::string> addresses;
+
+  void collect(const Expr& expr) { expr.accept(*this); }
+
+  void visit(const NumberExpr&) override {}
+  void visit(const BooleanExpr&) override {}
+
+  [[nodiscard]] static auto format_address(Symbol id, LexicalAddress address)
+      -> std::string
+  {
+    return address.is_global()
+               ? fmt::format("{}:global", id)
+               : fmt::format("{}:{},{}", id, address.depth, address.slot);
+  }
+
+  void visit(const VariableExpr& expr) override
+  {
+    addresses.push_back(format_address(expr.id, expr.address));
+  }
+
+  void visit(const ApplyExpr& expr) override
+  {
+    collect(*expr.func);
+    for (const auto& arg : expr.arguments) { collect(*arg); }
+  }
+
+  void visit(const LambdaExpr& expr) override
+  {
+    if (!expr.captures.empty()) {
+      std::vector<std::string> captures;
+      for (const auto& capture : expr.captures) {
+        captures.push_back(format_address(capture.variable, capture.address));
+      }
+      addresses.push_back(fmt::format("[{}]", fmt::join(captures, " ")));
+    }
+    collect(*expr.body);
+  }
+
+  void visit(const LetExpr& expr) override
+  {
+    for (const auto& binding : expr.bindings) { collect(*binding.expr); }
+    collect(*expr.body);
+  }
+
+  void visit(const IfExpr& expr) override
+  {
+    collect(*expr.cond_expr);
+    collect(*expr.if_expr);
+    collect(*expr.else_expr);
+  }
+};
+
+[[nodiscard]] auto resolve_addresses(std::string_view source) -> std::string
+{
+  AddressCollector collector;
+  for (const auto& toplevel : parse(source)) {
+    std::visit( //
+        overloaded{[&](const ExprPtr& expr) { collector.collect(*expr); },
+                   [&](const Definition& definition) {
+                     collector.collect(*definition.expr);
+                   },
+                   [](const Require&) {}},
+        toplevel);
+  }
+  return fmt::format("{}", fmt::join(collector.addresses, " "));
+}
+
+} // anonymous namespace
+
+TEST_CASE("Resolver")
+{
+  SECTION("free variables are globals")
+  {
+    REQUIRE(resolve_addresses("(+ x 1)") == "+:global x:global");
+  }
+
+  SECTION("lambda parameters")
+  {
+    REQUIRE(resolve_addresses("(lambda (x y) (+ y x))") ==
+            "+:global y:0,1 x:0,0");
+  }
+
+  SECTION("closures capture their free variables")
+  {
+    REQUIRE(resolve_addresses("(lambda (x) (lambda (y) (+ x y)))") ==
+            "[x:0,0] +:global x:1,0 y:0,0");
+  }
+
+  SECTION("captured variables are found in the frame outside of the body")
+  {
+    REQUIRE(resolve_addresses(
+                "(lambda (a) (let ((b 1)) (lambda (c) (let ((d c)) b))))") ==
+            "[b:0,0] c:0,0 b:2,0");
+  }
+
+  SECTION("closures capture each variable once")
+  {
+    REQUIRE(resolve_addresses("(lambda (x) (lambda () (+ x x)))") ==
+            "[x:0,0] +:global x:1,0 x:1,0");
+  }
+
+  SECTION("variables free in nested closures are captured by each of them")
+  {
+    REQUIRE(resolve_addresses("(lambda (x) (lambda () (lambda () x)))") ==
+            "[x:0,0] [x:1,0] x:1,0");
+  }
+
+  SECTION("let bindings are resolved in the outer scope")
+  {
+    REQUIRE(resolve_addresses("(lambda (x) (let ((x x) (y 1)) (+ x y)))") ==
+            "x:0,0 +:global x:0,0 y:0,1");
+  }
+
+  SECTION("the last duplicated parameter wins")
+  {
+    REQUIRE(resolve_addresses("(lambda (x x) x)") == "x:0,1");
+  }
+
+  SECTION("definitions")
+  {
+    REQUIRE(resolve_addresses("(define f (lambda (n) (f n)))") ==
+            "f:global n:0,0");
+  }
+}
@@ -1,4 +1,6 @@
 #include <string_view>
+#include <thread>
+#include <vector>
 
 #include "scanner.hpp"
 
@@ -25,7 +27,9 @@ TEST_CASE("Scanner Test")
   Token expected[] = {
       {.type = TokenType::left_paren, .lexeme = "("},
       {.type = TokenType::identifier, .lexeme = "+"},
-      {.type = TokenType::number, .lexeme = "42", .data = {.number = 42}},
+      {.type = TokenType::number,
+       .lexeme = "42",
+       .data = {.number = std::int64_t{42}}},
       {.type = TokenType::number, .lexeme = "0.5", .data = {.number = 0.5}},
       {.type = TokenType::right_paren, .lexeme = ")"},
   };
@@ -36,4 +40,50 @@ TEST_CASE("Scanner Test")
     ++itr;
   }
   REQUIRE(std::ranges::equal(results, expected));
-}
\ No newline at end of file
+}
+
+TEST_CASE("Scanner reads integer literals exactly")
+{
+  const auto number_of = [](std::string_view source) {
+    return Scanner{source}->data.number;
+  };
+  REQUIRE(number_of("9007199254740993") ==
+          Number{std::int64_t{9007199254740993}});
+  REQUIRE(number_of("-7") == Number{std::int64_t{-7}});
+  REQUIRE(number_of("1.0") == Number{1.0});
+  REQUIRE(number_of("1e3") == Number{1000.0});
+  REQUIRE(number_of("99999999999999999999") == Number{1e20});
+}
+
+TEST_CASE("Scanner interns identifiers")
+{
+  auto itr = Scanner{"(foo bar foo)"};
+  ++itr;
+  const Symbol foo = itr->data.symbol;
+  REQUIRE(foo.name() == "foo");
+  ++itr;
+  REQUIRE(itr->data.symbol.name() == "bar");
+  REQUIRE(itr->data.symbol != foo);
+  ++itr;
+  REQUIRE(itr->data.symbol == foo);
+  REQUIRE(foo == Symbol{"foo"});
+}
+
+TEST_CASE("Symbols are shared between threads")
+{
+  const Symbol before{"shared-symbol"};
+  std::vector<Symbol> symbols(8);
+  std::vector<std::thread> threads;
+  for (auto& symbol : symbols) {
+    threads.emplace_back([&symbol] {
+      for (int i = 0; i < 1000; ++i) {
+        static_cast<void>(Symbol{fmt::format("thread-symbol-{}", i)});
+      }
+      symbol = Symbol{"shared-symbol"};
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+
+  for (const auto symbol : symbols) { REQUIRE(symbol == before); }
+  REQUIRE(Symbol{"thread-symbol-999"}.name() == "thread-symbol-999");
+}
@@ -0,0 +1,42 @@
+#include <catch2/catch.hpp>
+
+#include "value_stack.hpp"
+
+TEST_CASE("Value stack")
+{
+  ValueStack stack;
+
+  SECTION("frames are contiguous and start out null")
+  {
+    const auto frame = stack.push(3);
+    REQUIRE(frame.values().size() == 3);
+    for (const auto& value : frame.values()) { REQUIRE(value.is_null()); }
+  }
+
+  SECTION("popping a frame releases its values")
+  {
+    auto& heap = Heap::current();
+    const auto object_count = heap.object_count();
+    {
+      const auto frame = stack.push(1);
+      frame.values()[0] = Value::make<Cons>(1.0, nullptr, true);
+      REQUIRE(heap.object_count() == object_count + 1);
+    }
+    REQUIRE(heap.object_count() == object_count);
+  }
+
+  SECTION("frames stay in place while frames are pushed on top of them")
+  {
+    const auto bottom = stack.push(4000);
+    bottom.values().back() = 42.0;
+    {
+      const auto middle = stack.push(1000);
+      middle.values().front() = 1.0;
+      const auto top = stack.push(10'000);
+      REQUIRE(top.values().size() == 10'000);
+    }
+    const auto next = stack.push(1);
+    REQUIRE(next.values().data() == bottom.values().data() + 4000);
+    REQUIRE(bottom.values().back() == Value{42.0});
+  }
+}
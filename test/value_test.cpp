@@ -0,0 +1,101 @@
+#include <catch2/catch.hpp>
+
+#include "value.hpp"
+
+#include <limits>
+
+TEST_CASE("Value representation")
+{
+  SECTION("a value fits in a machine word")
+  {
+    STATIC_REQUIRE(sizeof(Value) == 8);
+  }
+
+  SECTION("numbers")
+  {
+    const Value value{-0.5};
+    REQUIRE(value.is_number());
+    REQUIRE_FALSE(value.is_boolean());
+    REQUIRE_FALSE(value.is_object());
+    REQUIRE(value.as_number() == -0.5);
+  }
+
+  SECTION("NaN stays a number")
+  {
+    const Value value{std::numeric_limits<double>::quiet_NaN()};
+    REQUIRE(value.is_number());
+    REQUIRE(to_string(value) == "nan");
+    REQUIRE_FALSE(value == value);
+  }
+
+  SECTION("integers")
+  {
+    const auto small = Value::integer(-42);
+    REQUIRE(small.is_fixnum());
+    REQUIRE(small.is_integer());
+    REQUIRE(small.is_number());
+    REQUIRE_FALSE(small.is_double());
+    REQUIRE_FALSE(small.is_object());
+    REQUIRE(small.as_integer() == -42);
+    REQUIRE(small.as_number() == -42.0);
+    REQUIRE(small == Value{-42.0});
+    REQUIRE(to_string(small) == "-42");
+
+    const auto edge = Value::integer(Value::fixnum_min);
+    REQUIRE(edge.is_fixnum());
+    REQUIRE(edge.as_integer() == Value::fixnum_min);
+  }
+
+  SECTION("integers beyond 48 bits are boxed")
+  {
+    constexpr auto max = std::numeric_limits<std::int64_t>::max();
+    const auto large = Value::integer(max);
+    REQUIRE_FALSE(large.is_fixnum());
+    REQUIRE(large.is_integer());
+    REQUIRE(large.is_number());
+    REQUIRE(large.as_integer() == max);
+    REQUIRE(large == Value::integer(max));
+    REQUIRE_FALSE(large == Value::integer(max - 1));
+    REQUIRE(to_string(large) == "9223372036854775807");
+  }
+
+  SECTION("booleans and null")
+  {
+    REQUIRE(Value{true}.is_boolean());
+    REQUIRE(Value{true}.as_boolean());
+    REQUIRE_FALSE(Value{false}.as_boolean());
+    REQUIRE(Value{}.is_null());
+    REQUIRE(Value{nullptr}.is_null());
+    REQUIRE_FALSE(Value{nullptr}.is_number());
+    REQUIRE(to_string(Value{}) == "()");
+  }
+
+  SECTION("objects are shared between copies")
+  {
+    const Value cons = Value::make<Cons>(1.0, nullptr, true);
+    REQUIRE(cons.is_object());
+    REQUIRE(is_pair(cons));
+
+    Value copy = cons;
+    REQUIRE(copy == cons);
+    REQUIRE(copy.as_object() == cons.as_object());
+
+    const Value moved = MOV(copy);
+    REQUIRE(copy.is_null());
+    REQUIRE(to_string(moved) == "(1)");
+  }
+
+  SECTION("objects are identified by their type")
+  {
+    const Value cons = Value::make<Cons>(1.0, nullptr, true);
+    const Value integer = Value::integer(std::int64_t{1} << 60);
+    REQUIRE(cons.as_object()->type() == ObjectType::cons);
+    REQUIRE(object_cast<Cons>(cons.as_object()) == cons.as_object());
+    REQUIRE(object_cast<Proc>(cons.as_object()) == nullptr);
+    REQUIRE(object_cast<Cons>(Value{}.as_object()) == nullptr);
+    REQUIRE(object_cast<BoxedInteger>(integer.as_object())->value ==
+            std::int64_t{1} << 60);
+    REQUIRE(cons.as_object()->is_list());
+    REQUIRE_FALSE(integer.as_object()->is_procedural());
+  }
+}
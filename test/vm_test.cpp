@@ -0,0 +1,172 @@
+#include <catch2/catch.hpp>
+
+#include "fmt/format.h"
+#include "interpreter.hpp"
+#include "parser.hpp"
+
+namespace {
+
+[[nodiscard]] auto interpret_and_print(std::string_view source, Engine engine)
+    -> std::string
+{
+  Interpreter interpreter{InterpreterOptions{.engine = engine}};
+  std::vector<std::string> results;
+  try {
+    for (const auto& toplevel : parse(source)) {
+      if (auto value_opt = interpreter.interpret_toplevel(toplevel);
+          value_opt != std::nullopt) {
+        results.push_back(to_string(*value_opt));
+      }
+    }
+  } catch (const std::runtime_error& err) {
+    results.push_back(fmt::format("error: {}", err.what()));
+  }
+  return fmt::format("{}", fmt::join(results, "\n"));
+}
+
+[[nodiscard]] auto run_vm(std::string_view source) -> std::string
+{
+  const auto result = interpret_and_print(source, Engine::vm);
+  REQUIRE(result == interpret_and_print(source, Engine::tree_walker));
+  return result;
+}
+
+constexpr std::string_view fib_source = R"(
+(define fib-rec (lambda (x)
+  (if (< x 2)
+      x
+      (+ (fib-rec (- x 1)) (fib-rec (- x 2))))))
+(define fib-fold (lambda (x)
+  (car
+    (foldl
+      (lambda (_ acc)
+        (let ((a (car acc))
+              (b (cdr acc)))
+              (cons b (+ a b))))
+      (cons 0 1)
+      (range 0 x)))))
+(define fib-helper
+  (lambda (n a b)
+    (if (eq? n 0) a (fib-helper (- n 1) b (+ a b)))))
+(define fib (lambda (n) (fib-helper n 0 1)))
+)";
+
+} // anonymous namespace
+
+TEST_CASE("VM evaluation")
+{
+  SECTION("constants and builtins")
+  {
+    REQUIRE(run_vm("42") == "42");
+    REQUIRE(run_vm("true") == "true");
+    REQUIRE(run_vm("(+ 1 3 4)") == "8");
+    REQUIRE(run_vm("+") == "<builtin proc +>");
+  }
+
+  SECTION("lambda, let and closure")
+  {
+    REQUIRE(run_vm("(lambda (x y) (+ x y))") == "<proc (x y)>");
+    REQUIRE(run_vm("((lambda (x y) (+ x y)) 3 4)") == "7");
+    REQUIRE(run_vm("(((lambda (x) (lambda (y) (+ x y))) 3) 4)") == "7");
+    REQUIRE(run_vm("(let ((x 10) (y 20)) (+ x y))") == "30");
+    REQUIRE(run_vm("(let ((x 1)) (let ((x 2) (y x)) (+ x y)))") == "3");
+  }
+
+  SECTION("if expression")
+  {
+    REQUIRE(run_vm("(if (< 10 20) 10 20)") == "10");
+    REQUIRE(run_vm("(if (> 10 20) 10 20)") == "20");
+  }
+
+  SECTION("higher order builtins call back into the VM")
+  {
+    REQUIRE(run_vm("(map (lambda (x) (+ x 1)) (list 1 2 3 4 5))") ==
+            "(2 3 4 5 6)");
+    REQUIRE(run_vm("(filter (lambda (x) (> x 3)) (list 1 2 3 4 5))") ==
+            "(4 5)");
+    REQUIRE(run_vm("(foldr (lambda (x acc) (* (+ acc 1) x)) 0 (range 1 6))") ==
+            "153");
+  }
+
+  SECTION("recursion with definition")
+  {
+    REQUIRE(run_vm(fmt::format("{}(fib-rec 15) (fib-fold 15) (fib 15)",
+                               fib_source)) == "610\n610\n610");
+  }
+
+  SECTION("tail calls reuse the call frame")
+  {
+    REQUIRE(run_vm("(define loop (lambda (n acc)"
+                   "  (if (eq? n 0) acc"
+                   "      (let ((m (- n 1))) (loop m (+ acc 1))))))"
+                   "(loop 300000 0)") == "300000");
+    REQUIRE(run_vm("(define f (lambda (n) (let ((x n)) (+ x 1)))) (f 1)") ==
+            "2");
+  }
+
+  SECTION("non-tail recursion is not limited by the native stack")
+  {
+    REQUIRE(interpret_and_print(
+                "(define sum (lambda (n) (if (eq? n 0) 0 (+ n (sum (- n 1))))))"
+                "(sum 100000)",
+                Engine::vm) == "5000050000");
+  }
+
+  SECTION("exceeding the call depth limit is a runtime error")
+  {
+    Interpreter interpreter{
+        InterpreterOptions{.engine = Engine::vm, .max_call_depth = 1000}};
+    const auto program =
+        parse("(define sum (lambda (n) (if (eq? n 0) 0 (+ n (sum (- n 1))))))"
+              "(sum 5000)"
+              "(sum 500)");
+    interpreter.interpret_toplevel(program[0]);
+    REQUIRE_THROWS_WITH(
+        interpreter.interpret_toplevel(program[1]),
+        "Runtime error: maximum recursion depth of 1000 exceeded");
+    REQUIRE(to_string(*interpreter.interpret_toplevel(program[2])) ==
+            "125250");
+  }
+
+  SECTION("intrinsics behave like the builtins they stand for")
+  {
+    REQUIRE(run_vm("(- 5)") == "-5");
+    REQUIRE(run_vm("(< 1 2)") == "true");
+    REQUIRE(run_vm("(/ 1 0)") == "inf");
+    REQUIRE(run_vm("(eq? null (list))") == "true");
+    REQUIRE(run_vm("(cdr (cons 1 (cons 2 null)))") == "(2)");
+    REQUIRE(run_vm("(null? (cdr (list 1)))") == "true");
+    REQUIRE(run_vm("(let ((plus +)) (plus 1 2))") == "3");
+    REQUIRE(run_vm("(define + (lambda (x y) (* x y))) (+ 3 4)") == "12");
+    REQUIRE(run_vm("(+ 1 true)") ==
+            "error: Type error: (number? true) is false");
+    REQUIRE(run_vm("(< 1 null)") == "error: Type error: (number? ()) is false");
+    REQUIRE(run_vm("(car 1)") == "error: Type error: (pair? 1) is false");
+    REQUIRE(run_vm("(cdr null)") == "error: Type error: (pair? ()) is false");
+    REQUIRE(run_vm("(cons 1)").ends_with("expected: 2, given: 1"));
+    REQUIRE(run_vm("(null? 1 2)").ends_with("expected: 1, given: 2"));
+  }
+
+  SECTION("errors")
+  {
+    REQUIRE(run_vm("x") == "error: ReferenceError: x is not defined");
+    REQUIRE(run_vm("(12)") == "error: Type error: Cannot apply to 12!");
+    REQUIRE(run_vm("((list 1 2 3) 4)") ==
+            "error: Type error: cannot apply to cons cells");
+    REQUIRE(run_vm("((lambda (x y) (+ x y)) 3 4 5)")
+                .starts_with("error: Type error: arity mismatch"));
+    REQUIRE(run_vm("(if 1 10 20)").starts_with("error: Type error: 1 is not "
+                                               "a boolean"));
+    REQUIRE(run_vm("(define f (lambda (x) (car x))) (f 1)") ==
+            "error: Type error: (pair? 1) is false");
+    REQUIRE(run_vm("(map (lambda (x) (+ x y)) (list 1 2))") ==
+            "error: ReferenceError: y is not defined");
+  }
+
+  SECTION("the VM recovers after an error")
+  {
+    REQUIRE(run_vm("(define f (lambda (x) (+ x y))) (f 1)") ==
+            "error: ReferenceError: y is not defined");
+    REQUIRE(run_vm("(+ 1 2)") == "3");
+  }
+}